@@ -0,0 +1,261 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include "DoseGrid.h"
+#include "DoseArchive.h"
+
+DoseArchive::DoseArchive() {
+	phantomSize = 0;
+	scenarios = 0;
+	headerSize = 0;
+	scenarioSize = 0;
+}
+void DoseArchive::layout() {
+	// Sizes and offsets of the header, scenarios and slabs
+	headerSize = 8 + 3 * sizeof(int) + levels.size() * (4 * sizeof(double) + 9 * sizeof(int));
+	levelStart.clear();
+	scenarioSize = labelSize;
+	for (int l = 0; l < levels.size(); l++) {
+		levelStart.push_back(scenarioSize);
+		scenarioSize += (std::streamoff)levels[l].n[0] * (sizeof(double) + (std::streamoff)levels[l].n[1] * levels[l].n[2] * sizeof(unsigned short));
+	}
+}
+std::streamoff DoseArchive::slabOffset(int scenario, int l, int i) const {
+	const gridLevel& level = levels[l];
+	return headerSize + scenario * scenarioSize + levelStart[l] + (std::streamoff)i * (sizeof(double) + (std::streamoff)level.n[1] * level.n[2] * sizeof(unsigned short));
+}
+bool DoseArchive::matches(const DoseGrid& dose) const {
+	// True if dose has the levels and voxels of the archive
+	if (dose.size() != phantomSize || dose.numberLevels() != levels.size())
+		return false;
+	for (int l = 0; l < levels.size(); l++) {
+		const gridLevel& a = levels[l];
+		const gridLevel& b = dose.level(l);
+		if (a.voxelSize != b.voxelSize)
+			return false;
+		for (int i = 0; i < 3; i++) {
+			if (a.corner[i] != b.corner[i] || a.n[i] != b.n[i] || a.hole[0][i] != b.hole[0][i] || a.hole[1][i] != b.hole[1][i])
+				return false;
+		}
+	}
+	return true;
+}
+bool DoseArchive::create(std::string name, const DoseGrid& grid) {
+	/*
+	* Creates an empty archive for grids shaped like grid, replacing
+	* any file of the same name.
+	*/
+	if (file.is_open())
+		file.close();
+	fileName = name;
+	phantomSize = grid.size();
+	levels.clear();
+	for (int l = 0; l < grid.numberLevels(); l++) {
+		gridLevel level = grid.level(l);
+		level.dose.clear();
+		levels.push_back(level);
+	}
+	scenarios = 0;
+	layout();
+	file.open(fileName.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	int header[3] = {phantomSize, (int)levels.size(), scenarios};
+	file.write("DOSEARC1", 8);
+	file.write((const char*)header, sizeof(header));
+	for (int l = 0; l < levels.size(); l++) {
+		const gridLevel& level = levels[l];
+		file.write((const char*)&level.voxelSize, sizeof(double));
+		file.write((const char*)level.corner, 3 * sizeof(double));
+		file.write((const char*)level.n, 3 * sizeof(int));
+		file.write((const char*)level.hole, 6 * sizeof(int));
+	}
+	file.flush();
+	return (bool)file;
+}
+bool DoseArchive::open(std::string name) {
+	// Opens an archive to read or append to
+	if (file.is_open())
+		file.close();
+	fileName = name;
+	levels.clear();
+	scenarios = 0;
+	file.open(fileName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	char magic[8];
+	int header[3];
+	if (!file.read(magic, 8) || memcmp(magic, "DOSEARC1", 8) != 0 || !file.read((char*)header, sizeof(header)) || header[1] < 0) {
+		file.close();
+		return false;
+	}
+	phantomSize = header[0];
+	for (int l = 0; l < header[1]; l++) {
+		gridLevel level;
+		file.read((char*)&level.voxelSize, sizeof(double));
+		file.read((char*)level.corner, 3 * sizeof(double));
+		file.read((char*)level.n, 3 * sizeof(int));
+		file.read((char*)level.hole, 6 * sizeof(int));
+		levels.push_back(level);
+	}
+	scenarios = header[2];
+	layout();
+	if (!file) {
+		file.close();
+		return false;
+	}
+	return true;
+}
+bool DoseArchive::isOpen() const {
+	return file.is_open();
+}
+bool DoseArchive::append(const DoseGrid& dose, std::string label) {
+	// Adds dose, which must be shaped like the archive, as the next scenario
+	if (!file.is_open() || !matches(dose))
+		return false;
+	file.clear();
+	file.seekp(headerSize + scenarios * scenarioSize);
+	char name[labelSize];
+	memset(name, 0, labelSize);
+	strncpy(name, label.c_str(), labelSize - 1);
+	file.write(name, labelSize);
+	std::vector<unsigned short> values;
+	for (int l = 0; l < levels.size(); l++) {
+		const gridLevel& level = dose.level(l);
+		size_t slabSize = (size_t)level.n[1] * level.n[2];
+		values.resize(slabSize);
+		for (int i = 0; i < level.n[0]; i++) {
+			const double* slab = &level.dose[level.index(i, 0, 0)];
+			double max = 0;
+			for (size_t v = 0; v < slabSize; v++) {
+				if (slab[v] > max)
+					max = slab[v];
+			}
+			double scale = max / 65535;
+			for (size_t v = 0; v < slabSize; v++)
+				values[v] = scale > 0 && slab[v] > 0 ? (unsigned short)(slab[v] / scale + 0.5) : 0;
+			file.write((const char*)&scale, sizeof(double));
+			file.write((const char*)&values[0], slabSize * sizeof(unsigned short));
+		}
+	}
+	scenarios++;
+	file.seekp(8 + 2 * sizeof(int));
+	file.write((const char*)&scenarios, sizeof(int));
+	file.flush();
+	return (bool)file;
+}
+int DoseArchive::numberScenarios() const {
+	return scenarios;
+}
+std::string DoseArchive::label(int scenario) {
+	if (scenario < 0 || scenario >= scenarios)
+		return "";
+	char name[labelSize];
+	file.clear();
+	file.seekg(headerSize + scenario * scenarioSize);
+	file.read(name, labelSize);
+	name[labelSize - 1] = 0;
+	return file ? std::string(name) : "";
+}
+bool DoseArchive::readSlab(int scenario, int l, int i, std::vector<unsigned short>& values, double& scale) {
+	const gridLevel& level = levels[l];
+	values.resize((size_t)level.n[1] * level.n[2]);
+	file.clear();
+	file.seekg(slabOffset(scenario, l, i));
+	file.read((char*)&scale, sizeof(double));
+	file.read((char*)&values[0], values.size() * sizeof(unsigned short));
+	return (bool)file;
+}
+bool DoseArchive::readSlab(int scenario, int l, int i, std::vector<double>& slab) {
+	// The dose in the slab of constant x, voxel i of level l, of one scenario
+	if (scenario < 0 || scenario >= scenarios || l < 0 || l >= levels.size() || i < 0 || i >= levels[l].n[0])
+		return false;
+	std::vector<unsigned short> values;
+	double scale;
+	if (!readSlab(scenario, l, i, values, scale))
+		return false;
+	slab.resize(values.size());
+	for (size_t v = 0; v < values.size(); v++)
+		slab[v] = scale * values[v];
+	return true;
+}
+bool DoseArchive::read(int scenario, DoseGrid& dose) {
+	// dose is set to one scenario
+	if (scenario < 0 || scenario >= scenarios)
+		return false;
+	dose.define(phantomSize, levels);
+	std::vector<unsigned short> values;
+	for (int l = 0; l < levels.size(); l++) {
+		gridLevel& level = dose.level(l);
+		for (int i = 0; i < level.n[0]; i++) {
+			double scale;
+			if (!readSlab(scenario, l, i, values, scale))
+				return false;
+			double* slab = &level.dose[level.index(i, 0, 0)];
+			for (size_t v = 0; v < values.size(); v++)
+				slab[v] = scale * values[v];
+		}
+	}
+	return true;
+}
+bool DoseArchive::reduce(std::string statistic, DoseGrid& result, double percent) {
+	/*
+	* Sets result to the voxel-wise "min", "max", "mean" or
+	* "percentile" (percent, interpolated between scenarios) of all
+	* scenarios.  Only one slab of every scenario is held at a time.
+	*/
+	int kind = statistic == "min" ? 0 : statistic == "max" ? 1 : statistic == "mean" ? 2 : statistic == "percentile" ? 3 : -1;
+	if (scenarios == 0 || kind < 0)
+		return false;
+	result.define(phantomSize, levels);
+	double rank = percent / 100 * (scenarios - 1);
+	if (rank < 0)
+		rank = 0;
+	if (rank > scenarios - 1)
+		rank = scenarios - 1;
+	int lower = (int)floor(rank);
+	double fraction = rank - lower;
+	std::vector<unsigned short> values;
+	std::vector<double> doses;
+	std::vector<double> voxel(scenarios);
+	for (int l = 0; l < levels.size(); l++) {
+		gridLevel& level = result.level(l);
+		size_t slabSize = (size_t)level.n[1] * level.n[2];
+		doses.resize(slabSize * scenarios);
+		for (int i = 0; i < level.n[0]; i++) {
+			for (int s = 0; s < scenarios; s++) {
+				double scale;
+				if (!readSlab(s, l, i, values, scale))
+					return false;
+				for (size_t v = 0; v < slabSize; v++)
+					doses[v * scenarios + s] = scale * values[v];
+			}
+			double* slab = &level.dose[level.index(i, 0, 0)];
+			for (size_t v = 0; v < slabSize; v++) {
+				const double* d = &doses[v * scenarios];
+				if (kind == 0)
+					slab[v] = *std::min_element(d, d + scenarios);
+				else if (kind == 1)
+					slab[v] = *std::max_element(d, d + scenarios);
+				else if (kind == 2) {
+					double sum = 0;
+					for (int s = 0; s < scenarios; s++)
+						sum += d[s];
+					slab[v] = sum / scenarios;
+				}
+				else {
+					voxel.assign(d, d + scenarios);
+					std::nth_element(voxel.begin(), voxel.begin() + lower, voxel.end());
+					double value = voxel[lower];
+					if (fraction > 0) {
+						double next = *std::min_element(voxel.begin() + lower + 1, voxel.end());
+						value += fraction * (next - value);
+					}
+					slab[v] = value;
+				}
+			}
+		}
+	}
+	return true;
+}
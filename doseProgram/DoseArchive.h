@@ -0,0 +1,52 @@
+#ifndef DOSEARCHIVE_H
+#define DOSEARCHIVE_H
+#include <string>
+#include <vector>
+#include <fstream>
+#include "DoseGrid.h"
+
+class DoseArchive {
+	/*
+	* A file of dose grids of the same shape, e.g. the scenarios of a
+	* robustness or interplay study.  Each grid is stored as slabs of
+	* constant x on each level, every slab is quantised to 16 bits with
+	* its own scale, dose = scale * value, so a slab is within
+	* 1 / 131070 of its maximum.  All slabs of a level are the same size,
+	* so any scenario or slab is found without reading the others, and
+	* reductions across scenarios read one slab of every scenario at a
+	* time.  The file is in the byte order of the machine.
+	*
+	* Layout: "DOSEARC1", phantomSize, levels, scenarios (int32), each
+	* level (voxelSize, corner[3] as double, n[3], hole[2][3] as int32),
+	* then for each scenario a 64 byte label and its slabs (scale as a
+	* double followed by n[1] * n[2] uint16 values).
+	*/
+	static const int labelSize = 64;
+	std::string fileName;
+	std::fstream file;
+	int phantomSize;
+	std::vector<gridLevel> levels;			/* Levels of the stored grids, without dose */
+	int scenarios;
+	std::streamoff headerSize;
+	std::vector<std::streamoff> levelStart;	/* Offset of each level in a scenario */
+	std::streamoff scenarioSize;
+
+	void layout();
+	bool matches(const DoseGrid& dose) const;
+	std::streamoff slabOffset(int scenario, int l, int i) const;
+	bool readSlab(int scenario, int l, int i, std::vector<unsigned short>& values, double& scale);
+
+public:
+	DoseArchive();
+	bool create(std::string fileName, const DoseGrid& grid);
+	bool open(std::string fileName);
+	bool isOpen() const;
+	bool append(const DoseGrid& dose, std::string label);
+	int numberScenarios() const;
+	std::string label(int scenario);
+	bool read(int scenario, DoseGrid& dose);
+	bool readSlab(int scenario, int l, int i, std::vector<double>& slab);
+	bool reduce(std::string statistic, DoseGrid& result, double percent = 50);
+
+};
+#endif
@@ -0,0 +1,670 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include "DoseEngine.h"
+
+DoseEngine::DoseEngine() : braggPeaks(new PeakTable), penumbra(new map3D), movement(3), doseShift(3), intraMove(4) {
+	// Default Intitial Conditions, can be changed during runtime.
+	vars.phantomSize = 30;
+	vars.size = 100;
+	vars.margin = 0;
+	vars.beams = 1;
+	vars.minRange = 0;
+	vars.maxRange = 310;
+	vars.sd = 10;
+	vars.error = 2;
+	vars.spotSeparation = 5.0;
+	vars.voxelSize = 1.0;
+	vars.coarseVoxelSize = 1.0;
+	robust = false;
+	let = false;
+	rangeFactor = 1;
+	kernelFactor = 1;
+	summed = 0;
+	timelineDose = 0;
+	structureVersion = 0;
+	cancelled = false;
+	defineTarget();
+}
+bool DoseEngine::readJanni(std::string energyLossFile, std::string rangeEnergyFile) {
+	/*
+	* The Janni tables used by calculatePeaks() and calculatePenumbra()
+	* are read from the files instead of the compiled in tables, option j.
+	*/
+	if (!::readJanni(janniData, energyLossFile, rangeEnergyFile)) {
+		std::cout << "\nInput file Error";
+		return false;
+	}
+	stages.invalidate(Pipeline::peaks);
+	stages.invalidate(Pipeline::penumbra);
+	return true;
+}
+bool DoseEngine::loadPeaks(std::string fileName) {
+	/*
+	* Bragg peaks are read from fileName as they are needed, maxRange
+	* is set from the file.  Option i (inputAll).
+	*/
+	std::shared_ptr<PeakTable> table(new PeakTable);
+	if (!table->load(fileName, vars.sd, janniData)) {
+		std::cout << "\nInput file Error";
+		return false;
+	}
+	braggPeaks = table;
+	vars.maxRange = braggPeaks->maxRange();
+	kernels.clear();
+	stages.done(Pipeline::peaks, peaksKey());
+	return true;
+}
+bool DoseEngine::calculatePeaks() {
+	// Bragg peaks from minRange to maxRange calculated from Janni data, option 1
+	std::shared_ptr<PeakTable> table(new PeakTable);
+	bool ok = calcPeaks(*table, janniData, vars.minRange, vars.maxRange, vars.sd);
+	braggPeaks = table;
+	kernels.clear();
+	if (ok)
+		stages.done(Pipeline::peaks, peaksKey());
+	else
+		stages.invalidate(Pipeline::peaks);
+	return ok;
+}
+void DoseEngine::calculatePenumbra() {
+	// Option p (calcPenumbra)
+	penumbra.reset(new map3D(calcPenumbra(janniData, vars.maxRange)));
+	kernels.clear();
+	stages.done(Pipeline::penumbra, penumbraKey());
+}
+void DoseEngine::shareTables(const DoseEngine& engine) {
+	/*
+	* Uses the Bragg peaks and penumbra of engine.  They are never
+	* changed once shared, recalculating them replaces them in this
+	* engine only.
+	*/
+	braggPeaks = engine.braggPeaks;
+	penumbra = engine.penumbra;
+	vars.maxRange = engine.vars.maxRange;
+	kernels.clear();
+	stages.copy(engine.stages, Pipeline::peaks);
+	stages.copy(engine.stages, Pipeline::penumbra);
+}
+PeakTable& DoseEngine::peaks() {
+	return *braggPeaks;
+}
+const map3D& DoseEngine::penumbraTable() const {
+	return *penumbra;
+}
+const doseVariables& DoseEngine::variables() const {
+	return vars;
+}
+void DoseEngine::setVariables(const doseVariables& variables) {
+	vars = variables;
+	defineTarget();
+}
+bool DoseEngine::setGrid(double voxelSize, double coarseVoxelSize) {
+	// The coarse voxels must be a whole number of fine ones, the grid is unchanged otherwise
+	if (voxelSize <= 0 || !DoseGrid::nests(coarseVoxelSize, voxelSize)) {
+		std::cout << "\nVoxel size " << coarseVoxelSize << "mm is not a multiple of " << voxelSize << "mm, the grid is unchanged";
+		return false;
+	}
+	vars.voxelSize = voxelSize;
+	vars.coarseVoxelSize = coarseVoxelSize;
+	return true;
+}
+void DoseEngine::setMovement(const std::vector<int>& movementInput, const std::vector<double>& intraMoveInput) {
+	movement = movementInput;
+	intraMove = intraMoveInput;
+	movement.resize(3);
+	intraMove.resize(4);
+}
+void DoseEngine::setRobust(bool robustInput) {
+	robust = robustInput;
+}
+void DoseEngine::setLet(bool letInput) {
+	let = letInput;
+}
+bool DoseEngine::validRangeFactor(double factor) {
+	// Range errors of up to 50% either way, the tables are not made past that
+	return factor >= 0.5 && factor <= 1.5;
+}
+bool DoseEngine::setRangeFactor(double factor) {
+	// The dose is calculated with the tables scaled for a range error of factor
+	if (!validRangeFactor(factor)) {
+		std::cout << "\nRange factor " << factor << " is not between 0.5 and 1.5, the range factor is unchanged";
+		return false;
+	}
+	rangeFactor = factor;
+	return true;
+}
+bool DoseEngine::prepareRangeScenarios(const std::vector<double>& factors) {
+	/*
+	* Makes the scaled tables of every range factor in one pass, with
+	* the peaks of every range in the scan pattern, so the dose of each
+	* scenario is then calculated without making tables.
+	*/
+	for (int f = 0; f < factors.size(); f++) {
+		if (!validRangeFactor(factors[f])) {
+			std::cout << "\nRange factor " << factors[f] << " is not between 0.5 and 1.5, no tables made";
+			return false;
+		}
+	}
+	if (!updateTables())
+		return false;
+	std::vector<int> ranges;
+	for (int layer = 0; layer < SP.numberLayers(); layer++) {
+		for (int spot = 0; spot < SP.layerSize(layer); spot++) {
+			int z = (int)floor(SP.getSpot(layer, spot).z);
+			if (std::find(ranges.begin(), ranges.end(), z) == ranges.end())
+				ranges.push_back(z);
+		}
+	}
+	rangeTables.setNominal(braggPeaks, penumbra);
+	rangeTables.prepare(factors, ranges);
+	if (disp) std::cout << "\nTables ready for " << rangeTables.size() << " range scenarios";
+	return true;
+}
+void DoseEngine::setPattern(const ScanPattern& pattern) {
+	SP = pattern;
+	stages.done(Pipeline::pattern, 0);
+}
+void DoseEngine::definePattern() {
+	SP.defineScanPattern();
+	stages.done(Pipeline::pattern, 0);
+}
+size_t DoseEngine::peaksKey() const {
+	return fingerprint() << vars.maxRange << vars.sd;
+}
+size_t DoseEngine::penumbraKey() const {
+	return fingerprint() << vars.maxRange;
+}
+size_t DoseEngine::kernelKey() const {
+	// Penumbra the kernels are resampled from, shared by the engines that share it
+	return fingerprint() << stages.result(Pipeline::penumbra) << rangeFactor;
+}
+size_t DoseEngine::weightsKey() const {
+	return fingerprint() << stages.result(Pipeline::peaks) << vars.beams << vars.phantomSize << vars.size << vars.margin << vars.spotSeparation << vars.error;
+}
+size_t DoseEngine::gridKey() const {
+	// Tables and grid of a dose, the scan pattern and movement are added by doseKey()
+	return fingerprint() << stages.result(Pipeline::peaks) << stages.result(Pipeline::penumbra)
+		<< vars.phantomSize << vars.size << vars.margin << vars.voxelSize << vars.coarseVoxelSize << let << rangeFactor;
+}
+size_t DoseEngine::doseKey() const {
+	// The movement is compared separately, see doseCurrent()
+	return fingerprint() << gridKey() << stages.result(Pipeline::pattern) << intraMove;
+}
+size_t DoseEngine::normalisedKey(std::string structureName) const {
+	fingerprint key;
+	key << stages.result(Pipeline::dose) << structureName;
+	if (structureName != "max")
+		key << structureVersion << targetShift();
+	return key;
+}
+size_t DoseEngine::histogramKey() const {
+	return fingerprint() << stages.result(Pipeline::normalised) << structureVersion << targetShift();
+}
+bool DoseEngine::doseCurrent() const {
+	// phantom holds the dose calculated for the current tables, pattern, grid and movement
+	return stages.current(Pipeline::dose, doseKey()) && movement == doseShift;
+}
+bool DoseEngine::updateTables() {
+	/*
+	* The Bragg peaks and penumbra are recalculated if maxRange, sd or
+	* the Janni tables have changed since they were calculated or read.
+	* The scan pattern is given the intrafractional motion of intraMove.
+	*/
+	if (!stages.current(Pipeline::peaks, peaksKey()) || braggPeaks->minRange() > vars.minRange) {
+		if (disp) std::cout << "\nCalculating Bragg peaks";
+		if (!calculatePeaks()) {
+			std::cout << "\nError calculating the Bragg peaks";
+			return false;
+		}
+	}
+	if (!stages.current(Pipeline::penumbra, penumbraKey())) {
+		if (disp) std::cout << "\nCalculating penumbra";
+		calculatePenumbra();
+	}
+	if (!stages.computed(Pipeline::pattern))
+		definePattern();
+	Motion motion = SP.getMotion();
+	motion.setAxis(0, intraMove[0], intraMove[1]);
+	motion.setAxis(1, intraMove[2], intraMove[3]);
+	SP.setMotion(motion);
+	return true;
+}
+void DoseEngine::scenarioTables(std::shared_ptr<PeakTable>& peaks, std::shared_ptr<map3D>& profile) {
+	// Tables for the current range factor, the kernels are resampled when it changes
+	rangeTables.setNominal(braggPeaks, penumbra);
+	peaks = rangeTables.peaks(rangeFactor);
+	profile = rangeTables.penumbra(rangeFactor);
+	if (kernelFactor != rangeFactor) {
+		kernels.clear();
+		kernelFactor = rangeFactor;
+	}
+}
+void DoseEngine::doseCalculated() {
+	// phantom holds the normalised dose of the current inputs
+	stages.done(Pipeline::dose, doseKey());
+	normalisation = "max";
+	stages.done(Pipeline::normalised, normalisedKey(normalisation));
+	doseShift = movement;
+	summed = 0;
+}
+void DoseEngine::doseReplaced() {
+	// phantom was set outside the pipeline, it is used as it is until recalculated
+	stages.replaced(Pipeline::dose);
+	stages.replaced(Pipeline::normalised);
+	doseShift = movement;
+	summed = 0;
+}
+std::vector<int> DoseEngine::targetShift() const {
+	// Movement of the target relative to the dose that was calculated
+	std::vector<int> shift(3);
+	for (int a = 0; a < 3; a++)
+		shift[a] = movement[a] - doseShift[a];
+	return shift;
+}
+bool DoseEngine::update() {
+	/*
+	* Brings the dose up to date, recomputing only the stages that are
+	* out of date.  A dose that was set from outside the pipeline, by
+	* addDose() or an archive, is used as it is.
+	*/
+	if (stages.external(Pipeline::dose))
+		return true;
+	return computeDose();
+}
+void DoseEngine::pipelineStatus(std::ostream& out) const {
+	// Option stages, whether each stage is current for the present inputs
+	bool peaks = stages.status(Pipeline::peaks, peaksKey(), braggPeaks->minRange() <= vars.minRange, out);
+	bool penumbra = stages.status(Pipeline::penumbra, penumbraKey(), true, out);
+	stages.status(Pipeline::weights, weightsKey(), peaks, out);
+	bool pattern = stages.status(Pipeline::pattern, 0, true, out);
+	bool dose = stages.status(Pipeline::dose, doseKey(), peaks && penumbra && pattern && movement == doseShift, out);
+	bool normalised = stages.status(Pipeline::normalised, normalisedKey(normalisation), dose, out);
+	stages.status(Pipeline::histogram, histogramKey(), normalised, out);
+}
+bool DoseEngine::computeDose() {
+	/*
+	* Calculates and normalises the dose, option 4.  Nothing is
+	* calculated if the dose is current, in robustness mode a target
+	* shift is evaluated on the dose already calculated if it can be.
+	* The tables and pattern are updated first if they are out of date.
+	* Returns false if there was an error or it was cancelled.
+	*/
+	cancelled = false;
+	return runDose();
+}
+bool DoseEngine::runDose() {
+	// computeDose() without clearing a cancel, for compute() which clears it before starting the thread
+	if (!updateTables())
+		return false;
+	if (doseCurrent()) {
+		if (disp) std::cout << "\nThe dose is current";
+		return true;
+	}
+	std::vector<int> shift = targetShift();
+	if (robust && stages.current(Pipeline::dose, doseKey()) && shiftInvariant(phantom, shift, intraMove, vars.size, vars.phantomSize)) {
+		if (disp) std::cout << "\nTarget shift evaluated on the dose already calculated";
+		return true;
+	}
+	// if (weights.size() == 0) weight(weights, braggPeaks, beams, max, min, (int)spotSeparation, phantomSize, error);
+	if (disp) std::cout << " \n layers " << SP.numberLayers();
+	stages.invalidate(Pipeline::dose);
+	defineGrid(phantom, vars.phantomSize, vars.size, vars.margin, vars.voxelSize, vars.coarseVoxelSize);
+	if (let) phantom.enableLet();
+	std::shared_ptr<PeakTable> peaks;
+	std::shared_ptr<map3D> profile;
+	scenarioTables(peaks, profile);
+	if (!calculateDose(phantom, SP, *peaks, *profile, kernelKey(), kernels, movement, &cancelled))
+		return false;
+	normalise(phantom);
+	doseCalculated();
+	return true;
+}
+std::future<bool> DoseEngine::compute() {
+	// computeDose() in a new thread, cancel() stops it even before it starts
+	cancelled = false;
+	return std::async(std::launch::async, &DoseEngine::runDose, this);
+}
+bool DoseEngine::computeTimeDose(int bins) {
+	/*
+	* Calculates and normalises the dose as computeDose(), keeping the
+	* dose delivered in each of bins time bins over the delivery of the
+	* scan pattern, option t.  Nothing is calculated if the dose and
+	* bins are current.
+	*/
+	cancelled = false;
+	if (!updateTables())
+		return false;
+	if (doseCurrent() && timelineDose == stages.result(Pipeline::dose) && timeline.numberBins() == bins) {
+		if (disp) std::cout << "\nThe time bins are current";
+		return true;
+	}
+	stages.invalidate(Pipeline::dose);
+	defineGrid(phantom, vars.phantomSize, vars.size, vars.margin, vars.voxelSize, vars.coarseVoxelSize);
+	if (let) phantom.enableLet();
+	std::shared_ptr<PeakTable> peaks;
+	std::shared_ptr<map3D> profile;
+	scenarioTables(peaks, profile);
+	if (!calculateTimeDose(phantom, timeline, bins, SP, *peaks, *profile, kernelKey(), kernels, movement, &cancelled))
+		return false;
+	timeline.scale(normalise(phantom));
+	doseCalculated();
+	timelineDose = stages.result(Pipeline::dose);
+	return true;
+}
+bool DoseEngine::computeTiledDose(std::string fileName, double tileMB) {
+	/*
+	* Calculates and normalises the dose on voxels of vars.voxelSize
+	* over the whole phantom, held in tiles of tileMB in the file
+	* fileName, for grids that do not fit in memory.  The tiled dose is
+	* separate from the pipeline and is recalculated by every call, the
+	* LET is not calculated on it.
+	*/
+	cancelled = false;
+	if (!updateTables())
+		return false;
+	if (!largeDose.create(fileName, vars.phantomSize, vars.voxelSize, tileMB)) {
+		std::cout << "\n\nERROR with creating file " << fileName;
+		return false;
+	}
+	std::shared_ptr<PeakTable> peaks;
+	std::shared_ptr<map3D> profile;
+	scenarioTables(peaks, profile);
+	KernelCache kernel;
+	if (!calculateDose(largeDose, SP, *peaks, *profile, kernelKey(), kernel, movement, &cancelled))
+		return false;
+	normalise(largeDose);
+	return true;
+}
+void DoseEngine::cancel() {
+	// Stops the calculation that is running, it returns false, see DoseEngine.h
+	cancelled = true;
+}
+bool DoseEngine::addDose() {
+	/*
+	* Adds the dose of the scan pattern to the dose already in the
+	* phantom without normalising it, option c (calcDose).  The sum is
+	* started again if phantom holds anything else, or the tables or
+	* grid have changed.
+	*/
+	cancelled = false;
+	if (!updateTables())
+		return false;
+	size_t key = gridKey();
+	if (summed != key) {
+		defineGrid(phantom, vars.phantomSize, vars.size, vars.margin, vars.voxelSize, vars.coarseVoxelSize);
+		if (let) phantom.enableLet();
+	}
+	doseReplaced();
+	std::shared_ptr<PeakTable> peaks;
+	std::shared_ptr<map3D> profile;
+	scenarioTables(peaks, profile);
+	if (!calculateDose(phantom, SP, *peaks, *profile, kernelKey(), kernels, movement, &cancelled))
+		return false;
+	summed = key;
+	return true;
+}
+bool DoseEngine::normaliseDose(std::string structureName) {
+	// Normalises to 100% at the maximum in a structure moved by the current movement
+	if (!update())
+		return false;
+	const Structure* roi = structure(structureName);
+	if (roi == 0)
+		return false;
+	if (stages.current(Pipeline::normalised, normalisedKey(structureName)))
+		return true;
+	std::vector<int> shift = targetShift();
+	normalise(phantom, *roi, shift);
+	normalisation = structureName;
+	stages.done(Pipeline::normalised, normalisedKey(normalisation));
+	summed = 0;
+	return true;
+}
+void DoseEngine::normaliseDose() {
+	if (!update() || stages.current(Pipeline::normalised, normalisedKey("max")))
+		return;
+	normalise(phantom);
+	normalisation = "max";
+	stages.done(Pipeline::normalised, normalisedKey(normalisation));
+	summed = 0;
+}
+void DoseEngine::calculateWeights() {
+	// Option w (weight), also writes the file "weights", unless the weights are current
+	if (!updateTables())
+		return;
+	if (stages.current(Pipeline::weights, weightsKey())) {
+		if (disp) std::cout << "\nThe weights are current";
+		return;
+	}
+	int max = vars.phantomSize/2 + vars.size/2 + vars.margin;
+	int min = vars.phantomSize/2 - vars.size/2 - vars.margin;
+	weight(weights, *braggPeaks, vars.beams, max, min, (int)vars.spotSeparation, vars.phantomSize, vars.error);
+	stages.done(Pipeline::weights, weightsKey());
+}
+const DoseGrid& DoseEngine::dose() const {
+	return phantom;
+}
+const DoseTimeline* DoseEngine::timeResolved() const {
+	// The time bins of the current dose, 0 if they were not calculated with it
+	if (timelineDose == 0 || timelineDose != stages.result(Pipeline::dose) || !timeline.matches(phantom))
+		return 0;
+	return &timeline;
+}
+TiledGrid& DoseEngine::tiledDose() {
+	return largeDose;
+}
+bool DoseEngine::tiledHistogram(std::string name, std::vector<int>& DVH, std::vector<double>& stats) {
+	// DVH of one structure on the tiled dose, the structures are built on its voxels
+	if (!largeDose.isOpen()) {
+		std::cout << "\n\nERROR calculate dose first";
+		return false;
+	}
+	std::vector<Structure> tiled = structures;
+	for (int s = 0; s < tiled.size(); s++) {
+		tiled[s].build(largeDose.grid(), tiled);
+		if (tiled[s].name() == name) {
+			DVH = doseVolume(largeDose, tiled[s], stats);
+			return true;
+		}
+	}
+	std::cout << "\nNo structure " << name;
+	return false;
+}
+bool DoseEngine::letd(DoseGrid& result, double minDose) {
+	// Dose averaged LET of the dose, false if it was calculated without setLet(true)
+	if (!update())
+		return false;
+	if (!phantom.hasLet()) {
+		std::cout << "\nThe LET was not calculated with this dose, use setLet 1";
+		return false;
+	}
+	phantom.letd(result, minDose);
+	return true;
+}
+void DoseEngine::storeReference() {
+	// The current dose becomes the reference for gamma()
+	update();
+	reference = phantom;
+}
+const DoseGrid& DoseEngine::referenceDose() const {
+	return reference;
+}
+bool DoseEngine::gamma(GammaIndex& criteria) {
+	/*
+	* Gamma index of the current dose against the reference dose, the
+	* results are kept in criteria and the gamma map for gammaMap().
+	* Returns false, with no gamma map, if there is no reference dose.
+	*/
+	if (reference.numberLevels() == 0) {
+		std::cout << "\nNo reference dose, use storeReference first";
+		gammaDose = DoseGrid();
+		return false;
+	}
+	if (!update())
+		return false;
+	criteria.compare(reference, phantom, gammaDose);
+	return true;
+}
+const DoseGrid& DoseEngine::gammaMap() const {
+	return gammaDose;
+}
+bool DoseEngine::createArchive(std::string fileName) {
+	// A new scenario archive for grids shaped like the current dose
+	update();
+	if (phantom.numberLevels() == 0 || !archive.create(fileName, phantom)) {
+		std::cout << "\n\nERROR creating archive " << fileName;
+		return false;
+	}
+	return true;
+}
+bool DoseEngine::openArchive(std::string fileName) {
+	if (!archive.open(fileName)) {
+		std::cout << "\nInput file Error";
+		return false;
+	}
+	return true;
+}
+bool DoseEngine::archiveDose(std::string label) {
+	// The current dose is added to the archive as a scenario
+	update();
+	if (!archive.append(phantom, label)) {
+		std::cout << "\n\nERROR archiving the dose, is an archive open with the same grid?";
+		return false;
+	}
+	if (disp) std::cout << "\nScenario " << archive.numberScenarios() - 1 << " archived";
+	return true;
+}
+bool DoseEngine::readScenario(int scenario) {
+	// The current dose is replaced by a scenario from the archive
+	if (!archive.read(scenario, phantom)) {
+		std::cout << "\nNo scenario " << scenario;
+		return false;
+	}
+	doseReplaced();
+	return true;
+}
+bool DoseEngine::reduceScenarios(std::string statistic, double percent) {
+	/*
+	* The current dose is replaced by the voxel-wise min, max, mean or
+	* percentile of the archived scenarios.
+	*/
+	if (!archive.reduce(statistic, phantom, percent)) {
+		std::cout << "\nError reducing the archive: " << statistic;
+		return false;
+	}
+	doseReplaced();
+	return true;
+}
+DoseArchive& DoseEngine::scenarioArchive() {
+	return archive;
+}
+void DoseEngine::defineTarget() {
+	/*
+	* The target is the cube of vars.size at the centre of the phantom,
+	* the tissue is the rest of the phantom.  Structures loaded later
+	* may use them, they are rebuilt with them.
+	*/
+	std::vector<int> none(3);
+	double box[6];
+	structureVersion++;
+	targetBox(vars.size, vars.phantomSize, none, box, box + 3);
+	if (structures.size() < 2)
+		structures.resize(2);
+	structures[0] = Structure("target");
+	structures[0].add('+', "box", box);
+	structures[1] = Structure("tissue");
+	structures[1].add('+', "all", 0);
+	structures[1].add('-', "target", 0);
+}
+void DoseEngine::updateStructures() {
+	// Structures are rebuilt in order when the grid or a structure they use has changed
+	bool rebuild = false;
+	for (int s = 0; s < structures.size(); s++) {
+		if (rebuild || !structures[s].matches(phantom)) {
+			structures[s].build(phantom, structures);
+			rebuild = true;
+		}
+	}
+}
+sMap DoseEngine::histogram(std::vector<double>& maxMin) {
+	/*
+	* DVHs of every structure, moved by the current movement, option 6.
+	* maxMin is set to the maximum and minimum target dose.  The DVHs
+	* are only recalculated if the dose or structures have changed.
+	*/
+	update();
+	if (!stages.current(Pipeline::histogram, histogramKey())) {
+		std::vector<int> shift = targetShift();
+		doseVolMaxMin.resize(2);
+		updateStructures();
+		doseVol = calcDoseVol(phantom, structures, shift, doseVolMaxMin);
+		stages.done(Pipeline::histogram, histogramKey());
+	}
+	maxMin = doseVolMaxMin;
+	return doseVol;
+}
+bool DoseEngine::loadStructures(std::string fileName) {
+	/*
+	* Reads structures, one shape per line: name op type parameters,
+	* see Structure::read().  Shapes are added to a structure that
+	* already has the name.  Lines starting with # are ignored.
+	*/
+	std::ifstream inFile(fileName.c_str());
+	if (!inFile) {
+		std::cout << "\nInput file Error";
+		return false;
+	}
+	std::string line;
+	while (std::getline(inFile, line)) {
+		std::istringstream shape(line);
+		std::string name;
+		if (!(shape >> name) || name[0] == '#')
+			continue;
+		int s = 0;
+		while (s < structures.size() && structures[s].name() != name)
+			s++;
+		if (s == structures.size())
+			structures.push_back(Structure(name));
+		structureVersion++;
+		if (!structures[s].read(shape, structures)) {
+			std::cout << "\nError in structure " << name << ": " << line;
+			return false;
+		}
+	}
+	return true;
+}
+const Structure* DoseEngine::structure(std::string name) {
+	// The named structure built on the current grid, 0 if there is none
+	updateStructures();
+	for (int s = 0; s < structures.size(); s++) {
+		if (structures[s].name() == name)
+			return &structures[s];
+	}
+	std::cout << "\nNo structure " << name;
+	return 0;
+}
+bool DoseEngine::structureHistogram(std::string name, std::vector<int>& DVH, std::vector<double>& stats) {
+	// DVH, maximum, minimum and mean dose of one structure moved by the current movement
+	update();
+	const Structure* roi = structure(name);
+	if (roi == 0 || phantom.numberLevels() == 0)
+		return false;
+	std::vector<int> shift = targetShift();
+	DVH = doseVolume(phantom, *roi, shift, stats);
+	return true;
+}
+const std::map<int, double>& DoseEngine::spotWeights() const {
+	return weights;
+}
+bool DoseEngine::validate(Validation& suite, std::ostream& report) {
+	// Runs a validation suite with the Janni tables and sd of this engine
+	return suite.run(janniData, vars.sd, report);
+}
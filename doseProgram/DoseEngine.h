@@ -0,0 +1,165 @@
+#ifndef DOSEENGINE_H
+#define DOSEENGINE_H
+#include <string>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <future>
+#include "doseMaps.h"
+#include "ScanPattern.h"
+#include "DoseGrid.h"
+#include "TiledGrid.h"
+#include "DoseTimeline.h"
+#include "GammaIndex.h"
+#include "Structure.h"
+#include "DoseArchive.h"
+#include "KernelCache.h"
+#include "janniTables.h"
+#include "PeakTable.h"
+#include "doseCalc.h"
+#include "Pipeline.h"
+#include "Validation.h"
+#include "RangeScenarios.h"
+
+struct doseVariables {
+	/*
+	* Phantom, target and Bragg peak settings, set by option 2
+	* (setVariables) and setGrid in the dose program.
+	*/
+	int phantomSize;
+	int size;					/* Target size */
+	int margin;
+	int beams;
+	int minRange;
+	int maxRange;
+	double sd;					/* SOBP standard deviation */
+	double error;				/* Maximum SOBP error for weight() */
+	double spotSeparation;
+	double voxelSize;			/* In the target and margin */
+	double coarseVoxelSize;		/* In the surrounding tissue */
+};
+
+class DoseEngine {
+	/*
+	* The dose calculation as a library.  Holds the tables, scan pattern,
+	* target movement and dose of one plan; every option of the dose
+	* program is a method, and results are returned in memory.
+	* compute() runs in the background, the engine must not be changed
+	* until its future is ready.  cancel() stops the calculation that is
+	* running, from another thread, and it returns false; every
+	* calculation clears it when it starts, so a cancel() when nothing is
+	* running has no effect.  The Bragg peaks and penumbra may be
+	* shared with other engines, see shareTables().  Results are
+	* tracked by a Pipeline, anything that uses the dose recomputes
+	* only the stages whose inputs have changed since they were last
+	* calculated.
+	*/
+	janniTables janniData;
+	std::shared_ptr<PeakTable> braggPeaks;
+	std::shared_ptr<map3D> penumbra;
+	DoseGrid phantom;
+	std::vector<Structure> structures;		/* target, tissue, then any loaded, built on phantom when used */
+	DoseArchive archive;
+	TiledGrid largeDose;					/* Dose of the last computeTiledDose(), held in a file */
+	DoseGrid reference;						/* Dose stored by storeReference() */
+	DoseGrid gammaDose;						/* Gamma map of the last gamma() */
+	DoseTimeline timeline;					/* Time bins of the last computeTimeDose() */
+	std::vector<KernelCache> kernels;		/* braggPeaks and penumbra resampled to each level of phantom */
+	RangeScenarios rangeTables;				/* braggPeaks and penumbra scaled for range errors */
+	double rangeFactor;						/* Range error the dose is calculated for, 1 for none */
+	double kernelFactor;					/* Range factor of kernels */
+	ScanPattern SP;
+	std::map<int, double> weights;
+	doseVariables vars;
+	std::vector<int> movement;
+	std::vector<int> doseShift;				/* movement the dose in phantom was calculated for */
+	std::vector<double> intraMove;
+	bool robust;
+	bool let;								/* Calculate the dose averaged LET with the dose */
+	Pipeline stages;
+	std::string normalisation;				/* Structure the dose was last normalised to, "max" for the whole grid */
+	size_t summed;							/* Fingerprint of the grid and tables of the sum from addDose(), 0 if phantom is not one */
+	size_t timelineDose;					/* Dose result timeline was calculated with */
+	int structureVersion;					/* Changed whenever a structure is defined */
+	sMap doseVol;							/* DVHs of the last histogram() */
+	std::vector<double> doseVolMaxMin;
+	std::atomic<bool> cancelled;
+
+	size_t peaksKey() const;
+	size_t penumbraKey() const;
+	size_t kernelKey() const;
+	size_t weightsKey() const;
+	size_t gridKey() const;
+	size_t doseKey() const;
+	size_t normalisedKey(std::string structureName) const;
+	size_t histogramKey() const;
+	bool doseCurrent() const;
+	bool runDose();
+	bool updateTables();
+	void scenarioTables(std::shared_ptr<PeakTable>& peaks, std::shared_ptr<map3D>& profile);
+	void doseCalculated();
+	void doseReplaced();
+	std::vector<int> targetShift() const;
+	void defineTarget();
+	void updateStructures();
+
+public:
+	DoseEngine();
+	bool readJanni(std::string energyLossFile, std::string rangeEnergyFile);
+	bool loadPeaks(std::string fileName = "allPeaks");
+	bool calculatePeaks();
+	void calculatePenumbra();
+	void shareTables(const DoseEngine& engine);
+	PeakTable& peaks();
+	const map3D& penumbraTable() const;
+
+	const doseVariables& variables() const;
+	void setVariables(const doseVariables& variables);
+	bool setGrid(double voxelSize, double coarseVoxelSize);
+	void setMovement(const std::vector<int>& movement, const std::vector<double>& intraMove);
+	void setRobust(bool robust);
+	void setLet(bool let);
+	static bool validRangeFactor(double factor);
+	bool setRangeFactor(double factor);
+	bool prepareRangeScenarios(const std::vector<double>& factors);
+	void setPattern(const ScanPattern& pattern);
+	void definePattern();
+
+	bool update();
+	void pipelineStatus(std::ostream& out = std::cout) const;
+	bool computeDose();
+	std::future<bool> compute();
+	bool computeTimeDose(int bins);
+	bool computeTiledDose(std::string fileName, double tileMB);
+	void cancel();
+	bool addDose();
+	void normaliseDose();
+	bool normaliseDose(std::string structureName);
+	void calculateWeights();
+
+	const DoseGrid& dose() const;
+	const DoseTimeline* timeResolved() const;
+	TiledGrid& tiledDose();
+	bool tiledHistogram(std::string name, std::vector<int>& DVH, std::vector<double>& stats);
+	bool letd(DoseGrid& result, double minDose = 0);
+	void storeReference();
+	const DoseGrid& referenceDose() const;
+	bool gamma(GammaIndex& criteria);
+	const DoseGrid& gammaMap() const;
+	bool createArchive(std::string fileName);
+	bool openArchive(std::string fileName);
+	bool archiveDose(std::string label);
+	bool readScenario(int scenario);
+	bool reduceScenarios(std::string statistic, double percent = 50);
+	DoseArchive& scenarioArchive();
+	sMap histogram(std::vector<double>& maxMin);
+	bool loadStructures(std::string fileName);
+	const Structure* structure(std::string name);
+	bool structureHistogram(std::string name, std::vector<int>& DVH, std::vector<double>& stats);
+	const std::map<int, double>& spotWeights() const;
+	bool validate(Validation& suite, std::ostream& report);
+
+};
+#endif
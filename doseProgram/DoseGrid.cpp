@@ -0,0 +1,291 @@
+#include <vector>
+#include <cmath>
+#include "DoseGrid.h"
+
+double gridLevel::interpolate(double i, double j, double k) const {
+	/*
+	* Trilinear interpolation at a fractional voxel index, voxels
+	* outside the level have 0 dose.
+	*/
+	double point[3] = {i, j, k};
+	int base[3];
+	double f[3];
+	for (int a = 0; a < 3; a++) {
+		base[a] = (int)floor(point[a]);
+		f[a] = point[a] - base[a];
+	}
+	double value = 0;
+	for (int c = 0; c < 8; c++) {
+		int ijk[3];
+		double weight = 1;
+		bool inside = true;
+		for (int a = 0; a < 3; a++) {
+			int upper = (c >> a) & 1;
+			ijk[a] = base[a] + upper;
+			weight *= upper ? f[a] : 1 - f[a];
+			if (ijk[a] < 0 || ijk[a] >= n[a])
+				inside = false;
+		}
+		if (inside && weight > 0)
+			value += weight * dose[index(ijk[0], ijk[1], ijk[2])];
+	}
+	return value;
+}
+
+DoseGrid::DoseGrid() {
+	// Default constructor, an empty grid
+	phantomSize = 0;
+}
+DoseGrid::DoseGrid(int size, double voxelSize) {
+	// Uniform grid covering the whole phantom
+	define(size, voxelSize);
+}
+void DoseGrid::addLevel(double voxelSize, const double lo[3], const double hi[3], bool allocate) {
+	// Adds a level with voxel centres from lo up to hi (mm), without doses unless allocate
+	gridLevel level;
+	level.voxelSize = voxelSize;
+	for (int a = 0; a < 3; a++) {
+		level.corner[a] = lo[a];
+		level.n[a] = (int)((hi[a] - lo[a]) / voxelSize + 0.5);
+		if (level.n[a] < 1)
+			level.n[a] = 1;
+		level.hole[0][a] = 0;
+		level.hole[1][a] = 0;
+	}
+	if (allocate)
+		level.dose.assign((size_t)level.n[0] * level.n[1] * level.n[2], 0);
+	levels.push_back(level);
+}
+void DoseGrid::define(int size, double voxelSize) {
+	// A single level of voxelSize over the whole phantom
+	double lo[3] = {-size / 2.0, -size / 2.0, 0};
+	double hi[3] = {size / 2.0, size / 2.0, (double)size};
+	levels.clear();
+	phantomSize = size;
+	addLevel(voxelSize, lo, hi);
+}
+void DoseGrid::defineShape(int size, double voxelSize) {
+	// The voxels of define() without doses, for grids held elsewhere e.g. TiledGrid
+	double lo[3] = {-size / 2.0, -size / 2.0, 0};
+	double hi[3] = {size / 2.0, size / 2.0, (double)size};
+	levels.clear();
+	phantomSize = size;
+	addLevel(voxelSize, lo, hi, false);
+}
+void DoseGrid::define(int size, double coarseSize, double fineSize, const double fineMin[3], const double fineMax[3]) {
+	/*
+	* Coarse voxels over the whole phantom with a region of fine voxels
+	* between fineMin and fineMax.  The fine region is snapped outwards to
+	* coarse voxel boundaries so every coarse voxel is either wholly
+	* inside or outside it.
+	*/
+	define(size, coarseSize);
+	if (fineSize >= coarseSize)
+		return;
+	gridLevel& coarse = levels[0];
+	double lo[3], hi[3];
+	for (int a = 0; a < 3; a++) {
+		int first = (int)floor((fineMin[a] - coarse.corner[a]) / coarseSize + 0.5);
+		int last = (int)ceil((fineMax[a] - coarse.corner[a]) / coarseSize - 0.5);
+		if (first < 0) first = 0;
+		if (last > coarse.n[a]) last = coarse.n[a];
+		if (last <= first)
+			return;
+		coarse.hole[0][a] = first;
+		coarse.hole[1][a] = last;
+		/* Fine voxels fill the coarse voxels [first, last) exactly */
+		lo[a] = coarse.position(a, first) - coarseSize / 2 + fineSize / 2;
+		hi[a] = coarse.position(a, last) - coarseSize / 2 + fineSize / 2;
+	}
+	addLevel(fineSize, lo, hi);
+}
+void DoseGrid::define(int size, const std::vector<gridLevel>& shape) {
+	// Levels with the voxels of shape, the dose in shape is not used
+	phantomSize = size;
+	levels = shape;
+	for (int l = 0; l < levels.size(); l++) {
+		levels[l].dose.assign((size_t)levels[l].n[0] * levels[l].n[1] * levels[l].n[2], 0);
+		levels[l].doseLet.clear();
+	}
+}
+bool DoseGrid::nests(double coarseSize, double fineSize) {
+	// True if a coarse voxel is a whole number of fine voxels across, so the fine region fills it exactly
+	double ratio = coarseSize / fineSize;
+	return ratio >= 1 - 1e-9 && fabs(ratio - floor(ratio + 0.5)) < 1e-6 * ratio;
+}
+bool DoseGrid::matches(int size, double coarseSize, double fineSize) const {
+	// True if the grid was defined with these spacings
+	if (levels.empty() || size != phantomSize || levels[0].voxelSize != coarseSize)
+		return false;
+	if (fineSize >= coarseSize)
+		return levels.size() == 1;
+	return levels.size() == 2 && levels[1].voxelSize == fineSize;
+}
+int DoseGrid::numberLevels() const {
+	return levels.size();
+}
+int DoseGrid::size() const {
+	return phantomSize;
+}
+double DoseGrid::finestVoxelSize() const {
+	return levels.empty() ? 1 : levels.back().voxelSize;
+}
+gridLevel& DoseGrid::level(int l) {
+	return levels[l];
+}
+const gridLevel& DoseGrid::level(int l) const {
+	return levels[l];
+}
+bool DoseGrid::covered(int l, int i, int j, int k) const {
+	// True if the voxel is replaced by voxels of a finer level
+	const gridLevel& level = levels[l];
+	return i >= level.hole[0][0] && i < level.hole[1][0]
+		&& j >= level.hole[0][1] && j < level.hole[1][1]
+		&& k >= level.hole[0][2] && k < level.hole[1][2];
+}
+int DoseGrid::finestLevel(const double lo[3], const double hi[3]) const {
+	// The finest level whose voxels cover the box from lo to hi
+	for (int l = levels.size() - 1; l > 0; l--) {
+		const gridLevel& level = levels[l];
+		bool inside = true;
+		for (int a = 0; a < 3; a++) {
+			double half = level.voxelSize / 2;
+			if (lo[a] < level.corner[a] - half || hi[a] > level.position(a, level.n[a] - 1) + half)
+				inside = false;
+		}
+		if (inside)
+			return l;
+	}
+	return 0;
+}
+int DoseGrid::levelAt(double x, double y, double z) const {
+	double point[3] = {x, y, z};
+	return finestLevel(point, point);
+}
+double DoseGrid::doseAt(double x, double y, double z) const {
+	// Dose in the voxel containing the point (x, y, z), 0 outside the phantom
+	if (levels.empty())
+		return 0;
+	const gridLevel& level = levels[levelAt(x, y, z)];
+	double point[3] = {x, y, z};
+	int ijk[3];
+	for (int a = 0; a < 3; a++) {
+		ijk[a] = (int)floor((point[a] - level.corner[a]) / level.voxelSize + 0.5);
+		if (ijk[a] < 0 || ijk[a] >= level.n[a])
+			return 0;
+	}
+	return level.dose[level.index(ijk[0], ijk[1], ijk[2])];
+}
+double DoseGrid::interpolateAt(double x, double y, double z) const {
+	/*
+	* Trilinear interpolation between voxel centres of the finest level
+	* at (x, y, z), voxels covered by a finer level take its dose.
+	* Points within half a voxel of the edge take the edge dose, 0
+	* outside the phantom.
+	*/
+	if (levels.empty())
+		return 0;
+	int l = levelAt(x, y, z);
+	const gridLevel& level = levels[l];
+	double point[3] = {x, y, z};
+	int base[3];
+	double f[3];
+	for (int a = 0; a < 3; a++) {
+		double i = (point[a] - level.corner[a]) / level.voxelSize;
+		if (i < -0.5 || i > level.n[a] - 0.5)
+			return 0;
+		if (i < 0)
+			i = 0;
+		if (i > level.n[a] - 1)
+			i = level.n[a] - 1;
+		base[a] = (int)floor(i);
+		if (base[a] > level.n[a] - 2)
+			base[a] = level.n[a] > 1 ? level.n[a] - 2 : 0;
+		f[a] = i - base[a];
+	}
+	double value = 0;
+	for (int c = 0; c < 8; c++) {
+		int ijk[3];
+		double weight = 1;
+		for (int a = 0; a < 3; a++) {
+			int upper = (c >> a) & 1;
+			ijk[a] = base[a] + upper;
+			weight *= upper ? f[a] : 1 - f[a];
+		}
+		if (weight == 0)
+			continue;
+		if (covered(l, ijk[0], ijk[1], ijk[2]))
+			value += weight * doseAt(level.position(0, ijk[0]), level.position(1, ijk[1]), level.position(2, ijk[2]));
+		else
+			value += weight * level.dose[level.index(ijk[0], ijk[1], ijk[2])];
+	}
+	return value;
+}
+double DoseGrid::maxDose() const {
+	// Maximum dose in any voxel not covered by a finer level
+	double max = 0;
+	for (int l = 0; l < levels.size(); l++) {
+		const gridLevel& level = levels[l];
+		for (int i = 0; i < level.n[0]; i++) {
+			for (int j = 0; j < level.n[1]; j++) {
+				for (int k = 0; k < level.n[2]; k++) {
+					double dose = level.dose[level.index(i, j, k)];
+					if (dose > max && !covered(l, i, j, k))
+						max = dose;
+				}
+			}
+		}
+	}
+	return max;
+}
+void DoseGrid::scale(double factor) {
+	for (int l = 0; l < levels.size(); l++) {
+		std::vector<double>& dose = levels[l].dose;
+		for (size_t v = 0; v < dose.size(); v++)
+			dose[v] *= factor;
+		std::vector<double>& doseLet = levels[l].doseLet;
+		for (size_t v = 0; v < doseLet.size(); v++)
+			doseLet[v] *= factor;
+	}
+}
+void DoseGrid::clear() {
+	for (int l = 0; l < levels.size(); l++) {
+		levels[l].dose.assign(levels[l].dose.size(), 0);
+		levels[l].doseLet.assign(levels[l].doseLet.size(), 0);
+	}
+}
+void DoseGrid::enableLet() {
+	// Adds the dose times LET channel, addSpot() fills it alongside the dose
+	for (int l = 0; l < levels.size(); l++)
+		levels[l].doseLet.assign(levels[l].dose.size(), 0);
+}
+bool DoseGrid::hasLet() const {
+	return !levels.empty() && levels[0].doseLet.size() == levels[0].dose.size();
+}
+void DoseGrid::letd(DoseGrid& result, double minDose) const {
+	/*
+	* result is set to the dose averaged LET (keV/um), dose times LET
+	* over dose, in every voxel.  Voxels with less than minDose are 0.
+	*/
+	bool let = hasLet();
+	result.phantomSize = phantomSize;
+	result.levels.clear();
+	for (int l = 0; l < levels.size(); l++) {
+		const gridLevel& from = levels[l];
+		result.levels.push_back(gridLevel());
+		gridLevel& level = result.levels.back();
+		level.voxelSize = from.voxelSize;
+		for (int a = 0; a < 3; a++) {
+			level.corner[a] = from.corner[a];
+			level.n[a] = from.n[a];
+			level.hole[0][a] = from.hole[0][a];
+			level.hole[1][a] = from.hole[1][a];
+		}
+		level.dose.assign(from.dose.size(), 0);
+		for (size_t v = 0; v < from.dose.size(); v++) {
+			double dose = from.dose[v];
+			if (let && dose > minDose && dose > 0)
+				level.dose[v] = from.doseLet[v] / dose;
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef DOSEGRID_H
+#define DOSEGRID_H
+#include <vector>
+#include <cmath>
+
+struct gridLevel {
+	/*
+	* One resolution level of the dose grid.  Voxel (i, j, k) is
+	* centred on corner + (i, j, k) * voxelSize in mm, x and y are
+	* lateral (0 on the beam axis) and z is depth.  z is the fastest
+	* axis in memory.
+	*/
+	double voxelSize;
+	double corner[3];
+	int n[3];
+	int hole[2][3];			/* Voxels [hole[0], hole[1]) are covered by the next finer level */
+	std::vector<double> dose;
+	std::vector<double> doseLet;		/* Dose times LET, empty unless the LET is calculated */
+	size_t index(int i, int j, int k) const { return ((size_t)i * n[1] + j) * n[2] + k; }
+	double position(int axis, int i) const { return corner[axis] + i * voxelSize; }
+	void range(int axis, double lo, double hi, int& first, int& last) const {
+		/* Voxels [first, last) have centres in [lo, hi) */
+		first = (int)ceil((lo - corner[axis]) / voxelSize - 1e-9);
+		last = (int)ceil((hi - corner[axis]) / voxelSize - 1e-9);
+		if (first < 0) first = 0;
+		if (last > n[axis]) last = n[axis];
+		if (last < first) last = first;
+	}
+	double interpolate(double i, double j, double k) const;
+};
+
+class DoseGrid {
+	std::vector<gridLevel> levels;
+	int phantomSize;
+
+	void addLevel(double voxelSize, const double lo[3], const double hi[3], bool allocate = true);
+	int levelAt(double x, double y, double z) const;
+
+public:
+	DoseGrid();
+	DoseGrid(int phantomSize, double voxelSize);
+	void define(int phantomSize, double voxelSize);
+	void define(int phantomSize, double coarseSize, double fineSize, const double fineMin[3], const double fineMax[3]);
+	void define(int phantomSize, const std::vector<gridLevel>& shape);
+	void defineShape(int phantomSize, double voxelSize);
+	static bool nests(double coarseSize, double fineSize);
+	bool matches(int phantomSize, double coarseSize, double fineSize) const;
+	int numberLevels() const;
+	int size() const;
+	double finestVoxelSize() const;
+	gridLevel& level(int l);
+	const gridLevel& level(int l) const;
+	bool covered(int l, int i, int j, int k) const;
+	int finestLevel(const double lo[3], const double hi[3]) const;
+	double doseAt(double x, double y, double z) const;
+	double interpolateAt(double x, double y, double z) const;
+	double maxDose() const;
+	void enableLet();
+	bool hasLet() const;
+	void letd(DoseGrid& result, double minDose = 0) const;
+	void scale(double factor);
+	void clear();
+
+};
+#endif
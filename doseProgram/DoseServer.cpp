@@ -0,0 +1,200 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "DoseServer.h"
+
+/* Output of the job running on this thread, and whether it printed anything */
+thread_local std::streambuf* jobOutput = 0;
+thread_local bool jobPrinted = false;
+
+class JobOutput : public std::streambuf {
+	/*
+	* Buffer of std::cout while the server runs, what a worker writes
+	* goes to the output of its job and anything else to the terminal.
+	* It is unbuffered so the job's own output and std::cout stay in
+	* order.
+	*/
+	std::streambuf* terminal;
+
+	std::streambuf* target() {
+		if (!jobOutput)
+			return terminal;
+		jobPrinted = true;
+		return jobOutput;
+	}
+
+protected:
+	int overflow(int c) {
+		return c == EOF ? 0 : target()->sputc(c);
+	}
+	std::streamsize xsputn(const char* s, std::streamsize n) {
+		return target()->sputn(s, n);
+	}
+	int sync() {
+		return target()->pubsync();
+	}
+
+public:
+	JobOutput(std::streambuf* buffer) : terminal(buffer) {}
+};
+
+
+DoseServer::DoseServer(std::string path, int workerCount, void (*jobFunction)(std::istream& in, std::ostream& out)) {
+	socketPath = path;
+	workers = workerCount > 0 ? workerCount : 1;
+	job = jobFunction;
+	listener = -1;
+	stopping = false;
+}
+bool DoseServer::readJob(int client, std::string& text) {
+	// Reads until the client closes its end or sends a line "exit", false on an error or timeout
+	char buffer[4096];
+	while (true) {
+		ssize_t n = read(client, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return false;
+		if (n == 0)
+			return true;
+		text.append(buffer, n);
+		size_t last = text.rfind("exit");
+		if (last != std::string::npos && (last == 0 || text[last - 1] == '\n')
+			&& text.find_first_not_of(" \t\r\n", last + 4) == std::string::npos
+			&& text.find('\n', last) != std::string::npos)
+			return true;
+	}
+}
+void DoseServer::reply(int client, const std::string& text) {
+	size_t sent = 0;
+	while (sent < text.size()) {
+		ssize_t n = send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			return;
+		sent += n;
+	}
+}
+void DoseServer::work() {
+	// Worker thread, runs queued jobs until the server stops
+	while (true) {
+		int client;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (clients.empty() && !stopping)
+				waiting.wait(guard);
+			if (clients.empty())
+				return;
+			client = clients.front();
+			clients.pop();
+		}
+		std::string text;
+		if (readJob(client, text)) {
+			std::istringstream first(text);
+			std::string cmd;
+			first >> cmd;
+			if (cmd == "shutdown") {
+				reply(client, "shutdown\n");
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+				shutdown(listener, SHUT_RDWR);
+				waiting.notify_all();
+			}
+			else {
+				std::istringstream in(text);
+				std::ostringstream out;
+				jobOutput = out.rdbuf();
+				jobPrinted = false;
+				job(in, out);
+				jobOutput = 0;
+				out << (jobPrinted ? "error\n" : "ok\n");
+				reply(client, out.str());
+			}
+		}
+		close(client);
+	}
+}
+bool DoseServer::run() {
+	/*
+	* Listens on socketPath and hands connections to the workers,
+	* returns when the server is shut down, false if it stopped because
+	* connections could not be accepted.
+	*/
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		std::cout << "\nSocket path too long: " << socketPath;
+		return false;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socketPath.c_str());
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+		std::cout << "\nERROR cannot listen on " << socketPath;
+		return false;
+	}
+	JobOutput output(std::cout.rdbuf());
+	std::streambuf* terminal = std::cout.rdbuf(&output);
+	std::vector<std::thread> pool;
+	for (int i = 0; i < workers; i++)
+		pool.push_back(std::thread(&DoseServer::work, this));
+	timeval timeout = {clientTimeout, 0};
+	int backoff = 0;							/* ms to wait after running out of resources */
+	bool failed = false;
+	while (true) {
+		int client = accept(listener, 0, 0);
+		int error = errno;
+		if (client >= 0) {
+			setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (stopping) {
+				if (client >= 0)
+					close(client);
+				break;
+			}
+			if (client >= 0) {
+				clients.push(client);
+				waiting.notify_one();
+				backoff = 0;
+				continue;
+			}
+		}
+		/*
+		* Interrupted calls and connections dropped while queued are
+		* retried, running out of files or memory waits for jobs to
+		* finish, anything else means the socket is unusable.
+		*/
+		if (error == EINTR || error == ECONNABORTED)
+			continue;
+		std::cout << "\nERROR accepting a connection on " << socketPath << ": " << strerror(error);
+		if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+			backoff = backoff ? std::min(2 * backoff, 1000) : 10;
+			std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+			continue;
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		failed = true;
+		waiting.notify_all();
+		break;
+	}
+	for (int i = 0; i < pool.size(); i++)
+		pool[i].join();
+	std::cout.rdbuf(terminal);
+	close(listener);
+	unlink(socketPath.c_str());
+	return !failed;
+}
@@ -0,0 +1,43 @@
+#ifndef DOSESERVER_H
+#define DOSESERVER_H
+#include <string>
+#include <queue>
+#include <vector>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+
+class DoseServer {
+	/*
+	* Accepts jobs on a Unix domain socket.  A job is the text a client
+	* sends up to the end of its connection, or a line "exit", and is
+	* run by one of a pool of worker threads.  Whatever the job writes
+	* to its output stream is sent back before the connection is closed,
+	* followed by a line "ok".  What a job prints to std::cout is sent
+	* back with it and the line is "error" instead, as jobs print
+	* nothing else there (disp is false).
+	* A job of just "shutdown" stops the server.  A client that sends or
+	* receives nothing for clientTimeout seconds is dropped so it cannot
+	* hold a worker.
+	*/
+	std::string socketPath;
+	int workers;
+	void (*job)(std::istream& in, std::ostream& out);
+	int listener;
+	std::queue<int> clients;
+	std::mutex lock;
+	std::condition_variable waiting;
+	bool stopping;
+
+	void work();
+	static bool readJob(int client, std::string& text);
+	static void reply(int client, const std::string& text);
+
+public:
+	static const int clientTimeout = 30;
+
+	DoseServer(std::string path, int workers, void (*job)(std::istream& in, std::ostream& out));
+	bool run();
+
+};
+#endif
@@ -0,0 +1,200 @@
+#include <vector>
+#include "DoseGrid.h"
+#include "DoseTimeline.h"
+
+DoseTimeline::DoseTimeline() {
+	binWidth = 0;
+	cutoff = 0;
+	binStart.push_back(0);
+}
+void DoseTimeline::define(const DoseGrid& phantom, int bins, double deliveryTime, double cutoffInput) {
+	/*
+	* Forgets all bins, bins of deliveryTime / bins seconds can then
+	* be added in order for a grid shaped like phantom.
+	*/
+	binWidth = bins > 0 ? deliveryTime / bins : 0;
+	cutoff = cutoffInput;
+	layout = layoutOf(phantom);
+	offsets.assign(1, 0);
+	for (int l = 0; l < phantom.numberLevels(); l++)
+		offsets.push_back(offsets[l] + phantom.level(l).dose.size());
+	binStart.assign(1, 0);
+	runVoxel.clear();
+	runLength.clear();
+	doses.clear();
+}
+std::vector<double> DoseTimeline::layoutOf(const DoseGrid& grid) {
+	// The voxel size, corner, size and hole of every level
+	std::vector<double> shape;
+	for (int l = 0; l < grid.numberLevels(); l++) {
+		const gridLevel& level = grid.level(l);
+		shape.push_back(level.voxelSize);
+		for (int a = 0; a < 3; a++) {
+			shape.push_back(level.corner[a]);
+			shape.push_back(level.n[a]);
+			shape.push_back(level.hole[0][a]);
+			shape.push_back(level.hole[1][a]);
+		}
+	}
+	return shape;
+}
+bool DoseTimeline::matches(const DoseGrid& grid) const {
+	// True if the bins were recorded on a grid of the same layout as grid
+	return !layout.empty() && layout == layoutOf(grid);
+}
+double& DoseTimeline::voxelDose(DoseGrid& grid, size_t voxel) const {
+	int l = 0;
+	while (voxel >= offsets[l + 1])
+		l++;
+	return grid.level(l).dose[voxel - offsets[l]];
+}
+void DoseTimeline::addBin(DoseGrid& binDose, const std::vector<int>& box, DoseGrid& total) {
+	/*
+	* Appends the next bin from the dose in binDose, which is added to
+	* total and set back to 0.  Only columns i in [box[4l], box[4l+1])
+	* and j in [box[4l+2], box[4l+3]) of level l can have dose.
+	*/
+	double max = 0;
+	for (int l = 0; l < binDose.numberLevels() && !box.empty(); l++) {
+		gridLevel& level = binDose.level(l);
+		for (int i = box[4 * l]; i < box[4 * l + 1]; i++) {
+			for (int j = box[4 * l + 2]; j < box[4 * l + 3]; j++) {
+				size_t first = level.index(i, j, 0);
+				for (size_t v = first; v < first + level.n[2]; v++) {
+					if (level.dose[v] > max)
+						max = level.dose[v];
+				}
+			}
+		}
+	}
+	double smallest = max * cutoff;
+	for (int l = 0; l < binDose.numberLevels() && !box.empty(); l++) {
+		gridLevel& level = binDose.level(l);
+		std::vector<double>& totalDose = total.level(l).dose;
+		for (int i = box[4 * l]; i < box[4 * l + 1]; i++) {
+			for (int j = box[4 * l + 2]; j < box[4 * l + 3]; j++) {
+				size_t first = level.index(i, j, 0);
+				if (!level.doseLet.empty()) {
+					/* Dose times LET is only kept in the total */
+					std::vector<double>& totalLet = total.level(l).doseLet;
+					for (size_t v = first; v < first + level.n[2]; v++) {
+						totalLet[v] += level.doseLet[v];
+						level.doseLet[v] = 0;
+					}
+				}
+				bool inRun = false;
+				for (size_t v = first; v < first + level.n[2]; v++) {
+					double dose = level.dose[v];
+					if (dose == 0) {
+						inRun = false;
+						continue;
+					}
+					totalDose[v] += dose;
+					level.dose[v] = 0;
+					if (dose < smallest) {
+						inRun = false;
+						continue;
+					}
+					if (!inRun) {
+						runVoxel.push_back(offsets[l] + v);
+						runLength.push_back(0);
+						inRun = true;
+					}
+					runLength.back()++;
+					doses.push_back(dose);
+				}
+			}
+		}
+	}
+	binStart.push_back(runVoxel.size());
+}
+void DoseTimeline::scale(double factor) {
+	for (size_t d = 0; d < doses.size(); d++)
+		doses[d] *= factor;
+}
+int DoseTimeline::numberBins() const {
+	return binStart.size() - 1;
+}
+double DoseTimeline::binTime() const {
+	return binWidth;
+}
+size_t DoseTimeline::size() const {
+	// Number of voxel doses in all bins
+	return doses.size();
+}
+size_t DoseTimeline::bytes() const {
+	// Memory used by the stream
+	return runVoxel.size() * (sizeof(unsigned int) * 2) + doses.size() * sizeof(float) + binStart.size() * sizeof(size_t);
+}
+bool DoseTimeline::binDose(int bin, DoseGrid& dose) const {
+	/*
+	* dose, shaped like the phantom, is set to the dose delivered in bin.
+	* Returns false, leaving dose unchanged, if it is not shaped like the
+	* grid the bins were recorded on.
+	*/
+	if (!matches(dose))
+		return false;
+	dose.clear();
+	if (bin < 0 || bin >= numberBins())
+		return true;
+	size_t d = 0;
+	for (size_t r = 0; r < binStart[bin]; r++)
+		d += runLength[r];
+	for (size_t r = binStart[bin]; r < binStart[bin + 1]; r++) {
+		double* voxel = &voxelDose(dose, runVoxel[r]);
+		for (unsigned int k = 0; k < runLength[r]; k++)
+			voxel[k] += doses[d++];
+	}
+	return true;
+}
+bool DoseTimeline::doseRate(DoseGrid& rate) const {
+	// rate, shaped like the phantom, is set to the maximum dose rate (dose per s) over all bins, as binDose()
+	if (!matches(rate))
+		return false;
+	rate.clear();
+	if (binWidth <= 0)
+		return true;
+	size_t d = 0;
+	for (size_t r = 0; r < runVoxel.size(); r++) {
+		double* voxel = &voxelDose(rate, runVoxel[r]);
+		for (unsigned int k = 0; k < runLength[r]; k++, d++) {
+			if (doses[d] / binWidth > voxel[k])
+				voxel[k] = doses[d] / binWidth;
+		}
+	}
+	return true;
+}
+bool DoseTimeline::timeToDose(DoseGrid& time, double fraction) const {
+	/*
+	* time, shaped like the phantom, is set to the time (s) at the end
+	* of the bin in which each voxel reaches fraction of its total dose,
+	* 0 for voxels with no dose, as binDose().
+	*/
+	if (!matches(time))
+		return false;
+	DoseGrid total = time;
+	total.clear();
+	size_t d = 0;
+	for (size_t r = 0; r < runVoxel.size(); r++) {
+		double* voxel = &voxelDose(total, runVoxel[r]);
+		for (unsigned int k = 0; k < runLength[r]; k++)
+			voxel[k] += doses[d++];
+	}
+	time.clear();
+	DoseGrid delivered = total;
+	delivered.clear();
+	d = 0;
+	for (int b = 0; b < numberBins(); b++) {
+		for (size_t r = binStart[b]; r < binStart[b + 1]; r++) {
+			double* dose = &voxelDose(delivered, runVoxel[r]);
+			double* reached = &voxelDose(time, runVoxel[r]);
+			const double* finalDose = &voxelDose(total, runVoxel[r]);
+			for (unsigned int k = 0; k < runLength[r]; k++, d++) {
+				dose[k] += doses[d];
+				if (reached[k] == 0 && dose[k] >= fraction * finalDose[k])
+					reached[k] = (b + 1) * binWidth;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,43 @@
+#ifndef DOSETIMELINE_H
+#define DOSETIMELINE_H
+#include <vector>
+#include "DoseGrid.h"
+
+class DoseTimeline {
+	/*
+	* Dose delivered in each of a number of equal time bins.  Bins are
+	* kept as a stream of runs of dosed voxels along z, a run is its first
+	* voxel and length followed by the doses as floats, so a bin costs
+	* about 4 bytes per dosed voxel rather than a whole grid.  Doses less
+	* than cutoff times the maximum of their bin are not kept.  Voxels are
+	* numbered through each level of the dose grid in turn, so the bins
+	* are only read into grids of the same layout.
+	*/
+	double binWidth;						/* s */
+	double cutoff;
+	std::vector<double> layout;				/* Voxel size, corner, size and hole of every level of the grid */
+	std::vector<size_t> offsets;			/* Level l starts at voxel offsets[l] */
+	std::vector<size_t> binStart;			/* Bin b is runs [binStart[b], binStart[b + 1]) */
+	std::vector<unsigned int> runVoxel;
+	std::vector<unsigned int> runLength;
+	std::vector<float> doses;				/* Doses of every run in order */
+
+	double& voxelDose(DoseGrid& grid, size_t voxel) const;
+	static std::vector<double> layoutOf(const DoseGrid& grid);
+
+public:
+	DoseTimeline();
+	void define(const DoseGrid& phantom, int bins, double deliveryTime, double cutoff = 1e-4);
+	void addBin(DoseGrid& binDose, const std::vector<int>& box, DoseGrid& total);
+	void scale(double factor);
+	int numberBins() const;
+	double binTime() const;
+	size_t size() const;
+	size_t bytes() const;
+	bool matches(const DoseGrid& grid) const;
+	bool binDose(int bin, DoseGrid& dose) const;
+	bool doseRate(DoseGrid& rate) const;
+	bool timeToDose(DoseGrid& time, double fraction) const;
+
+};
+#endif
@@ -0,0 +1,168 @@
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include "DoseGrid.h"
+#include "GammaIndex.h"
+
+GammaIndex::GammaIndex(double doseDifferenceInput, double distanceInput, double thresholdInput, double maxGammaInput, int stepsPerVoxelInput) {
+	doseDifference = doseDifferenceInput;
+	distance = distanceInput;
+	threshold = thresholdInput;
+	maxGamma = maxGammaInput;
+	stepsPerVoxel = stepsPerVoxelInput > 0 ? stepsPerVoxelInput : 1;
+	points = 0;
+	passed = 0;
+	sum = 0;
+	max = 0;
+}
+static bool closer(const std::vector<double>& a, const std::vector<double>& b) {
+	return a[3] < b[3];
+}
+void GammaIndex::search(double evaluatedStep) {
+	/*
+	* Offsets on a grid of evaluatedStep / stepsPerVoxel within
+	* maxGamma * distance, sorted by distance.
+	*/
+	double step = evaluatedStep / stepsPerVoxel;
+	double radius = maxGamma * distance;
+	int n = (int)(radius / step);
+	std::vector<std::vector<double> > sorted;
+	for (int i = -n; i <= n; i++) {
+		for (int j = -n; j <= n; j++) {
+			for (int k = -n; k <= n; k++) {
+				double r2 = (i * i + j * j + k * k) * step * step;
+				if (r2 > radius * radius)
+					continue;
+				std::vector<double> offset(4);
+				offset[0] = i * step;
+				offset[1] = j * step;
+				offset[2] = k * step;
+				offset[3] = r2 / (distance * distance);
+				sorted.push_back(offset);
+			}
+		}
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), closer);
+	offsets.clear();
+	for (size_t o = 0; o < sorted.size(); o++)
+		offsets.insert(offsets.end(), sorted[o].begin(), sorted[o].end());
+}
+void GammaIndex::work(const DoseGrid& reference, const DoseGrid& evaluated, DoseGrid& gamma, double minDose, double doseCriterion) {
+	// One thread, evaluates slabs until there are none left
+	long slabPoints = 0;
+	long slabPassed = 0;
+	double slabSum = 0;
+	double slabMax = 0;
+	double limit = maxGamma * maxGamma;
+	size_t nOffsets = offsets.size() / 4;
+	while (true) {
+		int s = nextSlab++;
+		if (s >= slabs.size() / 2)
+			break;
+		int l = slabs[2 * s];
+		int i = slabs[2 * s + 1];
+		const gridLevel& level = reference.level(l);
+		gridLevel& map = gamma.level(l);
+		double x = level.position(0, i);
+		for (int j = 0; j < level.n[1]; j++) {
+			double y = level.position(1, j);
+			for (int k = 0; k < level.n[2]; k++) {
+				size_t v = level.index(i, j, k);
+				double dose = level.dose[v];
+				if (dose < minDose || reference.covered(l, i, j, k)) {
+					map.dose[v] = -1;
+					continue;
+				}
+				double z = level.position(2, k);
+				double best = limit;
+				for (size_t o = 0; o < nOffsets; o++) {
+					const double* offset = &offsets[4 * o];
+					if (offset[3] >= best)
+						break;			/* No further offset can have a lower gamma */
+					double difference = (evaluated.interpolateAt(x + offset[0], y + offset[1], z + offset[2]) - dose) / doseCriterion;
+					double g = offset[3] + difference * difference;
+					if (g < best)
+						best = g;
+				}
+				double value = sqrt(best);
+				map.dose[v] = value;
+				slabPoints++;
+				if (value <= 1)
+					slabPassed++;
+				slabSum += value;
+				if (value > slabMax)
+					slabMax = value;
+			}
+		}
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	points += slabPoints;
+	passed += slabPassed;
+	sum += slabSum;
+	if (slabMax > max)
+		max = slabMax;
+}
+double GammaIndex::compare(const DoseGrid& reference, const DoseGrid& evaluated, DoseGrid& gamma, int threads) {
+	/*
+	* Sets gamma, shaped like reference, to the gamma index of every
+	* reference voxel, capped at maxGamma, and -1 for voxels below the
+	* threshold.  Returns the % of evaluated voxels with gamma <= 1.
+	*/
+	gamma = reference;
+	points = 0;
+	passed = 0;
+	sum = 0;
+	max = 0;
+	if (reference.numberLevels() == 0 || evaluated.numberLevels() == 0)
+		return 0;
+	double maxDose = reference.maxDose();
+	search(evaluated.finestVoxelSize());
+	slabs.clear();
+	for (int l = 0; l < reference.numberLevels(); l++) {
+		for (int i = 0; i < reference.level(l).n[0]; i++) {
+			slabs.push_back(l);
+			slabs.push_back(i);
+		}
+	}
+	nextSlab = 0;
+	if (threads < 1)
+		threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	double minDose = threshold * maxDose / 100;
+	double doseCriterion = doseDifference * maxDose / 100;
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.push_back(std::thread(&GammaIndex::work, this, std::cref(reference), std::cref(evaluated), std::ref(gamma), minDose, doseCriterion));
+	work(reference, evaluated, gamma, minDose, doseCriterion);
+	for (int t = 0; t < pool.size(); t++)
+		pool[t].join();
+	return passRate();
+}
+double GammaIndex::doseCriterion() const {
+	return doseDifference;
+}
+double GammaIndex::distanceCriterion() const {
+	return distance;
+}
+double GammaIndex::lowDoseThreshold() const {
+	return threshold;
+}
+long GammaIndex::evaluatedPoints() const {
+	return points;
+}
+long GammaIndex::passedPoints() const {
+	return passed;
+}
+double GammaIndex::passRate() const {
+	return points > 0 ? (double)100 * passed / points : 0;
+}
+double GammaIndex::mean() const {
+	return points > 0 ? sum / points : 0;
+}
+double GammaIndex::maximum() const {
+	return max;
+}
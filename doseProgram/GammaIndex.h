@@ -0,0 +1,48 @@
+#ifndef GAMMAINDEX_H
+#define GAMMAINDEX_H
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "DoseGrid.h"
+
+class GammaIndex {
+	/*
+	* 3D gamma index of an evaluated dose against a reference dose
+	* (Low D. A. et. al. 1998), with a global dose difference criterion.
+	* For each reference voxel the evaluated dose is interpolated at
+	* offsets within maxGamma times the distance to agreement, searched
+	* in order of distance so the search stops as soon as no further
+	* offset can lower gamma.  Reference voxels are shared between
+	* threads by slabs in x.
+	*/
+	double doseDifference;				/* % of the maximum reference dose */
+	double distance;					/* Distance to agreement (mm) */
+	double threshold;					/* Reference voxels below threshold % of the maximum are not evaluated */
+	double maxGamma;					/* Gamma is not searched beyond this */
+	int stepsPerVoxel;					/* Search offsets per finest voxel of the evaluated dose */
+	std::vector<double> offsets;		/* (x, y, z, (r / distance)^2) sorted by r */
+	std::vector<int> slabs;				/* (level, i) of every slab of reference voxels */
+	std::atomic<int> nextSlab;
+	std::mutex lock;
+	long points;
+	long passed;
+	double sum;
+	double max;
+
+	void search(double evaluatedStep);
+	void work(const DoseGrid& reference, const DoseGrid& evaluated, DoseGrid& gamma, double minDose, double doseCriterion);
+
+public:
+	GammaIndex(double doseDifference = 3, double distance = 3, double threshold = 10, double maxGamma = 2, int stepsPerVoxel = 2);
+	double compare(const DoseGrid& reference, const DoseGrid& evaluated, DoseGrid& gamma, int threads = 0);
+	double doseCriterion() const;
+	double distanceCriterion() const;
+	double lowDoseThreshold() const;
+	long evaluatedPoints() const;
+	long passedPoints() const;
+	double passRate() const;
+	double mean() const;
+	double maximum() const;
+
+};
+#endif
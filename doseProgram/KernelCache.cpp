@@ -0,0 +1,225 @@
+#include <map>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include "doseMaps.h"
+#include "DoseGrid.h"
+#include "PeakTable.h"
+#include "KernelCache.h"
+
+std::mutex KernelCache::storeLock;
+std::map<KernelCache::shiftKey, std::weak_ptr<const std::vector<double> > > KernelCache::store;
+
+KernelCache::KernelCache() {
+	voxelSize = 0;
+	zCorner = 0;
+	nz = 0;
+	nLateral = 0;
+	lateralPhases = 1;
+	shiftWidth = 0;
+	minZ = 0;
+	maxZ = 0;
+	braggPeaks = 0;
+	rangeFactor = 1;
+	source = 0;
+}
+bool KernelCache::matches(const gridLevel& level) const {
+	return voxelSize == level.voxelSize && zCorner == level.corner[2] && nz == level.n[2];
+}
+void KernelCache::resample(const gridLevel& level, PeakTable& peaks, const map3D& penumbra, size_t penumbraKey) {
+	/*
+	* Resamples the penumbra onto the voxel centres of level, linear in
+	* depth and bilinear laterally.  Above 1 mm depth the 1 mm penumbra
+	* is used, below the deepest tabulated depth the deepest one is.
+	* penumbraKey identifies the penumbra, e.g. its Pipeline result, so
+	* the shifted kernels can be shared, 0 keeps them to this cache.
+	*/
+	voxelSize = level.voxelSize;
+	zCorner = level.corner[2];
+	nz = level.n[2];
+	nLateral = (int)(penumbraWidth / voxelSize);
+	lateralPhases = (int)ceil(voxelSize * phasesPerMm - 1e-9);
+	if (lateralPhases < 1)
+		lateralPhases = 1;
+	braggPeaks = &peaks;
+	rangeFactor = peaks.scaleFactor();
+	depth.clear();
+	depthLet.clear();
+	profile.clear();
+	source = penumbraKey;
+	shiftWidth = nLateral * lateralPhases + (lateralPhases + 1) / 2 + 1;
+	shifted.reset();
+	lateral.assign((size_t)(nLateral + 1) * (nLateral + 1) * nz, 0);
+	if (penumbra.empty())
+		return;
+	minZ = penumbra.begin()->first;
+	maxZ = penumbra.rbegin()->first;
+	/* Dense copy of the penumbra so the resampling does not search maps */
+	int width = penumbraWidth + 1;
+	profile.assign((size_t)(maxZ + 1) * width * width, 0);
+	for (map3D::const_iterator z = penumbra.begin(); z != penumbra.end(); z++) {
+		for (map2D::const_iterator x = z->second.begin(); x != z->second.end(); x++) {
+			for (std::map<int, double>::const_iterator y = x->second.begin(); y != x->second.end(); y++) {
+				if (z->first >= 0 && x->first >= 0 && x->first < width && y->first >= 0 && y->first < width)
+					profile[((size_t)z->first * width + x->first) * width + y->first] = y->second;
+			}
+		}
+	}
+	for (int k = 0; k < nz; k++) {
+		for (int x = 0; x <= nLateral; x++) {
+			for (int y = 0; y <= nLateral; y++)
+				lateral[((size_t)x * (nLateral + 1) + y) * nz + k] = profileAt(k, x * voxelSize, y * voxelSize);
+		}
+	}
+}
+double KernelCache::profileAt(int k, double X, double Y) const {
+	// Penumbra at the depth of voxel k, X and Y mm from the axis, 0 past penumbraWidth
+	if (X > penumbraWidth || Y > penumbraWidth)
+		return 0;
+	int width = penumbraWidth + 1;
+	double z = zCorner + k * voxelSize;
+	if (z < minZ) z = minZ;
+	if (z > maxZ) z = maxZ;
+	int z0 = (int)z;
+	int z1 = z0 < maxZ ? z0 + 1 : z0;
+	double fz = z - z0;
+	int x0 = (int)X;
+	int x1 = x0 < penumbraWidth ? x0 + 1 : x0;
+	double fx = X - x0;
+	int y0 = (int)Y;
+	int y1 = y0 < penumbraWidth ? y0 + 1 : y0;
+	double fy = Y - y0;
+	double value = 0;
+	int zs[2] = {z0, z1};
+	double wz[2] = {1 - fz, fz};
+	for (int a = 0; a < 2; a++) {
+		const double* plane = &profile[(size_t)zs[a] * width * width];
+		double lower = (1 - fx) * plane[x0 * width + y0] + fx * plane[x1 * width + y0];
+		double upper = (1 - fx) * plane[x0 * width + y1] + fx * plane[x1 * width + y1];
+		value += wz[a] * ((1 - fy) * lower + fy * upper);
+	}
+	return value;
+}
+void KernelCache::shift(std::vector<double>& table) const {
+	/*
+	* The penumbra x / lateralPhases voxels in x and y in y from the
+	* axis, a spot px / lateralPhases voxels from the centre of its
+	* voxel reaches the voxel i away at x = |i * lateralPhases - px|.
+	*/
+	table.assign((size_t)shiftWidth * shiftWidth * nz, 0);
+	if (profile.empty())
+		return;
+	for (int x = 0; x < shiftWidth; x++) {
+		double X = (double)x / lateralPhases * voxelSize;
+		for (int y = 0; y < shiftWidth; y++) {
+			double Y = (double)y / lateralPhases * voxelSize;
+			double* column = &table[((size_t)x * shiftWidth + y) * nz];
+			for (int k = 0; k < nz; k++)
+				column[k] = profileAt(k, X, Y);
+		}
+	}
+}
+KernelCache::shiftTable KernelCache::sharedShift() const {
+	/*
+	* The shifted kernels from the store, made by the first cache that
+	* needs them and kept while any cache still uses them.  Caches of
+	* other threads wait while they are made.
+	*/
+	std::shared_ptr<std::vector<double> > made(new std::vector<double>);
+	if (source == 0) {
+		shift(*made);
+		return made;
+	}
+	shiftKey key(source, voxelSize, zCorner, nz);
+	std::lock_guard<std::mutex> guard(storeLock);
+	shiftTable table = store[key].lock();
+	if (table)
+		return table;
+	for (std::map<shiftKey, std::weak_ptr<const std::vector<double> > >::iterator s = store.begin(); s != store.end(); ) {
+		/* Kernels no cache uses any more are already freed, their entries are dropped */
+		if (s->second.expired() && s->first != key)
+			store.erase(s++);
+		else
+			s++;
+	}
+	shift(*made);
+	store[key] = made;
+	return made;
+}
+int KernelCache::reach() const {
+	return nLateral;
+}
+int KernelCache::phases() const {
+	return lateralPhases;
+}
+const double* KernelCache::penumbra(int x, int y) const {
+	// Penumbra at all depths, x and y voxels from the central axis
+	return &lateral[((size_t)x * (nLateral + 1) + y) * nz];
+}
+const double* KernelCache::penumbra(int x, int y, const int phase[2]) {
+	/*
+	* Penumbra at all depths x and y voxels from the voxel nearest a
+	* spot that is phase / lateralPhases voxels from its centre.  The
+	* shifted kernels are taken from the store the first time a spot is
+	* off the centre of its voxel.
+	*/
+	if (phase[0] == 0 && phase[1] == 0)
+		return penumbra(abs(x), abs(y));
+	if (!shifted)
+		shifted = sharedShift();
+	int X = abs(x * lateralPhases - phase[0]);
+	int Y = abs(y * lateralPhases - phase[1]);
+	return &(*shifted)[((size_t)X * shiftWidth + Y) * nz];
+}
+double KernelCache::maxDepth(double range) const {
+	// Deepest dose of a peak of the given range, peakTail past it stretched with the peaks
+	return (range + peakTail) * rangeFactor;
+}
+const std::vector<double>& KernelCache::depthDose(double range) {
+	/*
+	* Depth dose of the Bragg peak with the given range at each voxel
+	* depth, linearly interpolated, and 0 beyond maxDepth().
+	* Ranges are binned to 1 / phasesPerMm mm, a fractional range is the
+	* peak of the whole mm below shifted deeper.
+	*/
+	int bin = (int)floor(range * phasesPerMm + 0.5);
+	std::map<int, std::vector<double> >::iterator found = depth.find(bin);
+	if (found != depth.end())
+		return found->second;
+	std::vector<double>& curve = depth[bin];
+	int peak = (int)floor((double)bin / phasesPerMm);
+	double offset = (double)bin / phasesPerMm - peak;
+	curve.assign(nz, 0);
+	for (int k = 0; k < nz; k++) {
+		double z = zCorner + k * voxelSize - offset;
+		if (z < 0 || z > (peak + peakTail) * rangeFactor)
+			continue;
+		int z0 = (int)z;
+		double fz = z - z0;
+		curve[k] = (1 - fz) * braggPeaks->dose(peak, z0) + fz * braggPeaks->dose(peak, z0 + 1);
+	}
+	return curve;
+}
+const std::vector<double>& KernelCache::depthDoseLet(double range) {
+	/*
+	* Depth dose times the dose averaged LET of the Bragg peak at each
+	* voxel depth, as depthDose().
+	*/
+	int bin = (int)floor(range * phasesPerMm + 0.5);
+	std::map<int, std::vector<double> >::iterator found = depthLet.find(bin);
+	if (found != depthLet.end())
+		return found->second;
+	std::vector<double>& curve = depthLet[bin];
+	int peak = (int)floor((double)bin / phasesPerMm);
+	double offset = (double)bin / phasesPerMm - peak;
+	curve.assign(nz, 0);
+	for (int k = 0; k < nz; k++) {
+		double z = zCorner + k * voxelSize - offset;
+		if (z < 0 || z > (peak + peakTail) * rangeFactor)
+			continue;
+		int z0 = (int)z;
+		double fz = z - z0;
+		curve[k] = (1 - fz) * braggPeaks->dose(peak, z0) * braggPeaks->letd(peak, z0) + fz * braggPeaks->dose(peak, z0 + 1) * braggPeaks->letd(peak, z0 + 1);
+	}
+	return curve;
+}
@@ -0,0 +1,69 @@
+#ifndef KERNELCACHE_H
+#define KERNELCACHE_H
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include "doseMaps.h"
+#include "DoseGrid.h"
+#include "janniTables.h"
+#include "PeakTable.h"
+
+class KernelCache {
+	/*
+	* The Bragg peaks and penumbra, tabulated per mm, resampled onto
+	* the voxels of one grid level.  Depth doses are resampled the first
+	* time a range is used.  Spots between voxel centres use a kernel
+	* shifted by the nearest 1 / phases of a voxel, about a quarter mm,
+	* and ranges are binned to a quarter mm, so the dose is still added
+	* without interpolating each voxel.  Every shifted kernel is a
+	* sample of one table of the penumbra at 1 / phases of a voxel,
+	* about (4 * penumbraWidth)^2 columns, 85 MB for 400 1 mm voxels in
+	* depth.  It is shared by every cache resampled from the same
+	* penumbra onto the same depths, e.g. the engines of a server.
+	*/
+	typedef std::tuple<size_t, double, double, int> shiftKey;	/* penumbra, voxelSize, zCorner, nz */
+	typedef std::shared_ptr<const std::vector<double> > shiftTable;
+	double voxelSize;
+	double zCorner;
+	int nz;
+	int nLateral;								/* Kernel reaches nLateral voxels either side of the spot */
+	int lateralPhases;							/* Spots are placed to 1 / lateralPhases of a voxel */
+	std::vector<double> lateral;				/* lateral[(x * (nLateral + 1) + y) * nz + k] */
+	int shiftWidth;								/* Offsets of shifted kernels, in 1 / lateralPhases voxels, are below shiftWidth */
+	shiftTable shifted;							/* Penumbra at offsets of 1 / lateralPhases voxels, [(x * shiftWidth + y) * nz + k] */
+	size_t source;								/* Key of the penumbra the kernels were resampled from, 0 if it is not shared */
+	std::vector<double> profile;				/* Dense copy of the penumbra, [(z * (penumbraWidth + 1) + x) * (penumbraWidth + 1) + y] */
+	int minZ;
+	int maxZ;
+	std::map<int, std::vector<double> > depth;	/* depth[range * phasesPerMm][k] */
+	std::map<int, std::vector<double> > depthLet;	/* Depth dose times LET */
+	PeakTable* braggPeaks;
+	double rangeFactor;						/* Range factor of braggPeaks, the tail is scaled with the peaks */
+
+	double profileAt(int k, double X, double Y) const;
+	void shift(std::vector<double>& table) const;
+	shiftTable sharedShift() const;
+
+	static std::mutex storeLock;
+	static std::map<shiftKey, std::weak_ptr<const std::vector<double> > > store;	/* Shifted kernels in use by any cache */
+
+public:
+	static const int penumbraWidth = penumbraCutoff;
+	static const int peakTail = 40;				/* Dose is calculated up to 40 mm past the nominal peak */
+	static const int phasesPerMm = 4;			/* Spot positions and ranges are binned to 1/4 mm */
+
+	KernelCache();
+	bool matches(const gridLevel& level) const;
+	void resample(const gridLevel& level, PeakTable& peaks, const map3D& penumbra, size_t penumbraKey = 0);
+	int reach() const;
+	int phases() const;
+	const double* penumbra(int x, int y) const;
+	const double* penumbra(int x, int y, const int phase[2]);
+	double maxDepth(double range) const;
+	const std::vector<double>& depthDose(double range);
+	const std::vector<double>& depthDoseLet(double range);
+
+};
+#endif
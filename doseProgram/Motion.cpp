@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cmath>
 #include "spotPos.h"
 #include "Motion.h"
 
@@ -7,34 +8,63 @@ Motion::Motion() {
 	xVec = 0;
 	yVec = 0;
 	zVec = 0;
-	motionPeriod = 0;
-	std::cout << "\nDefault motion constructor\nx = " << xVec << "\ny = " << yVec << "\nz = " << zVec << "\nperiod = " << motionPeriod;
+	for (int a = 0; a < 3; a++)
+		motionPeriod[a] = 0;
 }
 Motion::Motion(double x, double y, double z, double period){
 	// constructor that assigns all the variables
 	xVec = x;
 	yVec = y;
 	zVec = z;
-	motionPeriod = period;
-	std::cout << "\nMotion constructor\nx = " << xVec << "\ny = " << yVec << "\nz = " << zVec << "\nperiod = " << motionPeriod;
+	for (int a = 0; a < 3; a++)
+		motionPeriod[a] = period;
 }
 spotPos Motion::moveSpot(spotPos SP, double deliveryTime) const {
-	//move the spot according to the motion of the object and return the moved spot
+	/*
+	* move the spot according to the motion of the object and return the
+	* moved spot, i.e. the spot relative to the target moves by minus
+	* the movement of the target at deliveryTime (s).
+	*/
+	const double vec[3] = {xVec, yVec, zVec};
+	double move[3];
+	for (int a = 0; a < 3; a++) {
+		if (motionPeriod[a] > 0)
+			move[a] = vec[a] * sin(2 * 3.141592654 * deliveryTime / motionPeriod[a]);
+		else
+			move[a] = vec[a] * deliveryTime;
+	}
+	SP.x -= move[0];
+	SP.y -= move[1];
+	SP.z -= move[2];
+	return SP;
 }
 void Motion::setMotion(double x, double y, double z, double period) {
 	// Sets the motion
 	xVec = x;
 	yVec = y;
 	zVec = z;
-	motionPeriod = period;
-	std::cout << "\nDefault motion constructor\nx = " << xVec << "\ny = " << yVec << "\nz = " << zVec << "\nperiod = " << motionPeriod;
+	for (int a = 0; a < 3; a++)
+		motionPeriod[a] = period;
 }
 void Motion::addMotion(double x, double y, double z, double period) {
 	// Adds extra motion
 	xVec = xVec + x;
 	yVec = yVec + y;
 	zVec = zVec + z;
-	motionPeriod = period;
-	std::cout << "\nDefault motion constructor\nx = " << xVec << "\ny = " << yVec << "\nz = " << zVec << "\nperiod = " << motionPeriod;
+	for (int a = 0; a < 3; a++)
+		motionPeriod[a] = period;
+}
+void Motion::setAxis(int axis, double vec, double period) {
+	// Sets the motion on one axis only
+	if (axis == 0)
+		xVec = vec;
+	else if (axis == 1)
+		yVec = vec;
+	else
+		zVec = vec;
+	motionPeriod[axis] = period;
+}
+bool Motion::still() const {
+	return xVec == 0 && yVec == 0 && zVec == 0;
 }
 
@@ -3,11 +3,16 @@
 #include "spotPos.h"
 
 class Motion {
+	/*
+	* Intrafractional motion of the target.  On each axis the target
+	* moves as vec * sin(2 pi t / period), or drifts at vec mm/s if the
+	* period is 0, t is the time from the start of the delivery.
+	*/
 	int variableDefsHere;
 	double xVec;
 	double yVec;
 	double zVec;
-	double motionPeriod;
+	double motionPeriod[3];			/* Period (s) of the motion in x, y and z */
 
 public:
 	Motion();
@@ -15,6 +20,8 @@ public:
 	spotPos moveSpot(spotPos SP, double deliveryTime) const;
 	void setMotion(double x, double y, double z, double period);
 	void addMotion(double x, double y, double z, double period);
+	void setAxis(int axis, double vec, double period);
+	bool still() const;
 
 };
 #endif
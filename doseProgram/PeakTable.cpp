@@ -0,0 +1,247 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "PeakTable.h"
+
+PeakTable::PeakTable() {
+	first = 0;
+	last = 0;
+	sd = 10;
+	maxCalc = 0;
+	rangeFactor = 1;
+}
+void PeakTable::reset(int minRange, int maxRange) {
+	// Forgets all peaks, ranges minRange to maxRange - 1 can then be used
+	first = minRange;
+	last = maxRange > minRange ? maxRange : minRange;
+	curves.assign(last - first, std::vector<double>());
+	ready = std::vector<std::once_flag>(last - first);
+	lets.assign(last - first, std::vector<double>());
+	letReady = std::vector<std::once_flag>(last - first);
+	Dmono.clear();
+	stopping.clear();
+	peakFile.clear();
+	offsets.clear();
+	nominal.reset();
+	rangeFactor = 1;
+}
+bool PeakTable::configure(int minRange, int maxRange, double sdInput, const janniTables& janniData) {
+	/*
+	* Peaks will be calculated with the formula from M. Lee et. al. 1993
+	* from the energy loss per mm in janniData.  Dmono(R,Z) is
+	* tabulated here, it is needed by every peak.
+	*/
+	reset(minRange, maxRange);
+	sd = sdInput;
+	maxCalc = maxRange + 10;
+	if (janniData.energyLoss.empty())
+		return false;
+	tabulate(janniData);
+	return true;
+}
+void PeakTable::tabulate(const janniTables& janniData) {
+	// Tabulates the energy loss and Dmono(R,Z) for ranges up to maxCalc
+	stopping.assign(maxCalc, 0);		/* stopping[R] is the energy loss per mm for a proton with range R. */
+	for (int R = 0; R < maxCalc && R < janniData.energyLoss.size(); R++)
+		stopping[R] = janniData.energyLoss[R];
+	Dmono.assign((size_t)maxCalc * maxCalc, 0);
+	for (int R = 0; R < maxCalc; R++) {
+		double denomintor = (double)1 / (0.0012*R+1);
+		double* row = &Dmono[(size_t)R * maxCalc];
+		for (int dist = 0; dist <= R; dist++){
+			row[R - dist] = stopping[dist] * (0.0012*dist+1) * denomintor;
+		}
+	}
+}
+bool PeakTable::load(std::string fileName, double sdInput, const janniTables& janniData) {
+	/*
+	* Peaks will be read from a file written by outputAll(), the
+	* first number is maxRange followed by maxRange (depth, dose) lines
+	* for each range from 0.  Only the position of each peak in the file
+	* is found here.  The LET is calculated from janniData with sd as
+	* the file does not have it.
+	*/
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	if (!inFile)
+		return false;
+	int maxRange;
+	inFile >> maxRange;
+	if (!inFile || maxRange < 1)
+		return false;
+	reset(0, maxRange);
+	std::ostringstream contents;
+	inFile.seekg(0);
+	contents << inFile.rdbuf();
+	peakFile = contents.str();
+	/* Each peak starts after 1 + range * maxRange lines */
+	const char* start = peakFile.c_str();
+	const char* end = start + peakFile.size();
+	const char* p = start;
+	int line = 0;
+	while (p < end && offsets.size() < (size_t)maxRange) {
+		const char* next = (const char*)memchr(p, '\n', end - p);
+		if (!next)
+			break;
+		line++;
+		p = next + 1;
+		if (line >= 1 && (line - 1) % maxRange == 0)
+			offsets.push_back(p - start);
+	}
+	if (offsets.size() < (size_t)maxRange) {
+		reset(0, 0);
+		return false;
+	}
+	sd = sdInput;
+	maxCalc = maxRange + 10;
+	tabulate(janniData);
+	return true;
+}
+int PeakTable::minRange() const {
+	return first;
+}
+int PeakTable::maxRange() const {
+	return last;
+}
+void PeakTable::fill(int range) {
+	if (nominal)
+		stretch(nominal->curve(range), rangeFactor, curves[range - first]);
+	else if (peakFile.empty())
+		calculate(range, curves[range - first]);
+	else
+		read(range, curves[range - first]);
+}
+void PeakTable::fillLet(int range) {
+	/*
+	* Dose averaged LET at each depth of the peak, the LET of protons
+	* with range R at depth Z is the energy loss with residual range
+	* R - Z, weighted by their dose Dmono(R,Z) in eqn 3 from Lee et. al.
+	*/
+	std::vector<double>& curve = lets[range - first];
+	if (nominal) {
+		stretch(nominal->letd(range), rangeFactor, curve);
+		return;
+	}
+	curve.assign(maxCalc, 0);
+	if (Dmono.empty())
+		return;
+	int Ro = range + 3;
+	std::vector<double> dose(maxCalc, 0);
+	for (int R = 0; R < maxCalc; R++) {
+		double gauss = exp(-(R - Ro) * (R - Ro) / sd);
+		const double* mono = &Dmono[(size_t)R * maxCalc];
+		for (int Z = 0; Z <= R; Z++) {
+			dose[Z] += gauss * mono[Z];
+			curve[Z] += gauss * mono[Z] * stopping[R - Z];
+		}
+	}
+	for (int Z = 0; Z < maxCalc; Z++)
+		curve[Z] = dose[Z] > 0 ? curve[Z] / dose[Z] : 0;
+}
+bool PeakTable::scale(std::shared_ptr<PeakTable> nominalTable, double factor) {
+	/*
+	* Peaks of nominalTable for a range error, each reaching factor times
+	* as deep, e.g. 1.035 for a 3.5% lower stopping power.  The depth dose
+	* and LET at depth z are those of the nominal peak at z / factor,
+	* divided by factor as the energy is lost over a longer distance.
+	* Each peak is stretched the first time it is used.
+	*/
+	if (!nominalTable || factor <= 0)
+		return false;
+	reset(nominalTable->first, nominalTable->last);
+	sd = nominalTable->sd;
+	maxCalc = (int)ceil(nominalTable->maxCalc * factor);
+	nominal = nominalTable;
+	rangeFactor = factor;
+	return true;
+}
+double PeakTable::scaleFactor() const {
+	return rangeFactor;
+}
+void PeakTable::stretch(const std::vector<double>& from, double factor, std::vector<double>& to) {
+	// to[z] = from(z / factor) / factor, linear between mm
+	to.assign(from.empty() ? 0 : (size_t)ceil(from.size() * factor), 0);
+	for (size_t z = 0; z < to.size(); z++) {
+		double depth = z / factor;
+		size_t z0 = (size_t)depth;
+		if (z0 + 1 >= from.size()) {
+			if (z0 < from.size())
+				to[z] = from[z0] / factor;
+			continue;
+		}
+		double f = depth - z0;
+		to[z] = ((1 - f) * from[z0] + f * from[z0 + 1]) / factor;
+	}
+}
+void PeakTable::calculate(int range, std::vector<double>& curve) const {
+	/*
+	* Depth dose for a peak with a mean range of range + 3 mm, eqn 3 from
+	* Lee et. al., integrated in cubic mm by summing the values at each
+	* mm.  Due to the way the data is stored this is the most accurate
+	* method, the Simpson rule or other rule would not work as well.
+	*/
+	curve.assign(maxCalc, 0);
+	if (Dmono.empty())
+		return;
+	int Ro = range + 3;
+	std::vector<double> gauss(maxCalc);
+	for (int R = 0; R < maxCalc; R++) {
+		double rrsd = (R - Ro) * (R - Ro) / sd;
+		gauss[R] = exp(-rrsd);
+	}
+	for (int R = 0; R < maxCalc; R++) {
+		const double* mono = &Dmono[(size_t)R * maxCalc];
+		for (int Z = 0; Z <= R; Z++)
+			curve[Z] += gauss[R] * mono[Z];
+	}
+}
+void PeakTable::read(int range, std::vector<double>& curve) const {
+	// Parses one peak from the contents of the allPeaks file
+	curve.assign(last, 0);
+	const char* p = peakFile.c_str() + offsets[range];
+	for (int Z = 0; Z < last; Z++) {
+		char* end;
+		long depth = strtol(p, &end, 10);
+		double energy = strtod(end, &end);
+		if (end == p)
+			break;
+		if (depth >= 0 && depth < last)
+			curve[depth] = energy;
+		p = end;
+	}
+}
+const std::vector<double>& PeakTable::curve(int range) {
+	// The depth dose for range, calculated or read the first time it is used
+	if (range < first || range >= last)
+		return none;
+	std::call_once(ready[range - first], &PeakTable::fill, this, range);
+	return curves[range - first];
+}
+const std::vector<double>& PeakTable::letd(int range) {
+	// The dose averaged LET (keV/um) for range, calculated the first time it is used
+	if (range < first || range >= last)
+		return none;
+	std::call_once(letReady[range - first], &PeakTable::fillLet, this, range);
+	return lets[range - first];
+}
+double PeakTable::letd(int range, int depth) {
+	const std::vector<double>& let = letd(range);
+	if (depth < 0 || depth >= let.size())
+		return 0;
+	return let[depth];
+}
+const std::vector<double>& PeakTable::operator[](int range) {
+	return curve(range);
+}
+double PeakTable::dose(int range, int depth) {
+	// Depth dose at depth mm for range, 0 outside the table
+	const std::vector<double>& peak = curve(range);
+	if (depth < 0 || depth >= peak.size())
+		return 0;
+	return peak[depth];
+}
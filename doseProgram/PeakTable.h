@@ -0,0 +1,60 @@
+#ifndef PEAKTABLE_H
+#define PEAKTABLE_H
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "janniTables.h"
+
+class PeakTable {
+	/*
+	* Depth dose of the Bragg peaks with ranges from minRange to
+	* maxRange, per mm.  A peak is calculated, or read from the
+	* allPeaks file, the first time it is used, so only the ranges in
+	* the scan pattern are ever evaluated.  curve() may be called from
+	* several threads, configure() and load() may not.  The dose
+	* averaged LET of each peak, from the same stopping powers, is
+	* calculated the first time it is used.  A table made by scale()
+	* stretches the peaks of a nominal table in depth for a range error.
+	*/
+	int first;
+	int last;
+	double sd;
+	int maxCalc;
+	std::vector<double> Dmono;					/* Dmono[R * maxCalc + Z] is Dmono(R,Z) in eqn 1 from Lee et. al. */
+	std::vector<double> stopping;				/* stopping[R] is the energy loss per mm (keV/um) with residual range R */
+	std::string peakFile;						/* Contents of allPeaks, empty when calculating */
+	std::vector<size_t> offsets;				/* Start of each peak in peakFile */
+	std::vector<std::vector<double> > curves;
+	std::vector<std::once_flag> ready;
+	std::vector<std::vector<double> > lets;
+	std::vector<std::once_flag> letReady;
+	std::vector<double> none;
+	std::shared_ptr<PeakTable> nominal;			/* Set by scale() */
+	double rangeFactor;
+
+	static void stretch(const std::vector<double>& from, double factor, std::vector<double>& to);
+
+	void reset(int minRange, int maxRange);
+	void tabulate(const janniTables& janniData);
+	void fill(int range);
+	void fillLet(int range);
+	void calculate(int range, std::vector<double>& curve) const;
+	void read(int range, std::vector<double>& curve) const;
+
+public:
+	PeakTable();
+	bool configure(int minRange, int maxRange, double sd, const janniTables& janniData);
+	bool load(std::string fileName, double sd, const janniTables& janniData);
+	bool scale(std::shared_ptr<PeakTable> nominalTable, double factor);
+	double scaleFactor() const;
+	int minRange() const;
+	int maxRange() const;
+	const std::vector<double>& curve(int range);
+	const std::vector<double>& operator[](int range);
+	double dose(int range, int depth);
+	const std::vector<double>& letd(int range);
+	double letd(int range, int depth);
+
+};
+#endif
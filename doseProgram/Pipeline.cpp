@@ -0,0 +1,69 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include "Pipeline.h"
+
+static std::atomic<size_t> lastResult(0);		/* Result ids are shared by every Pipeline */
+
+Pipeline::Pipeline() : stages(numberStages) {
+	const char* names[numberStages] = {"peaks", "penumbra", "weights", "pattern", "dose", "normalised", "histogram"};
+	for (int s = 0; s < numberStages; s++) {
+		stages[s].name = names[s];
+		stages[s].valid = false;
+		stages[s].external = false;
+		stages[s].inputs = 0;
+		stages[s].result = ++lastResult;
+	}
+}
+bool Pipeline::current(int s, size_t inputs) const {
+	// True if the stage was computed from these inputs
+	return stages[s].valid && !stages[s].external && stages[s].inputs == inputs;
+}
+bool Pipeline::computed(int s) const {
+	return stages[s].valid;
+}
+bool Pipeline::external(int s) const {
+	return stages[s].valid && stages[s].external;
+}
+size_t Pipeline::result(int s) const {
+	return stages[s].result;
+}
+void Pipeline::done(int s, size_t inputs) {
+	// The stage has been computed from inputs
+	stages[s].valid = true;
+	stages[s].external = false;
+	stages[s].inputs = inputs;
+	stages[s].result = ++lastResult;
+}
+void Pipeline::replaced(int s) {
+	// The result was set from outside the pipeline, it is kept until recomputed
+	stages[s].valid = true;
+	stages[s].external = true;
+	stages[s].result = ++lastResult;
+}
+void Pipeline::invalidate(int s) {
+	stages[s].valid = false;
+	stages[s].result = ++lastResult;
+}
+void Pipeline::copy(const Pipeline& from, int s) {
+	// A result shared with another engine, e.g. its tables
+	stages[s] = from.stages[s];
+}
+bool Pipeline::status(int s, size_t inputs, bool upstream, std::ostream& out) const {
+	/*
+	* Writes whether the stage is current, upstream is false if a stage
+	* it uses is out of date.  Returns true if it is current.
+	*/
+	bool current = stages[s].valid && (stages[s].external || (upstream && stages[s].inputs == inputs));
+	out << "\n" << stages[s].name << ": ";
+	if (!stages[s].valid)
+		out << "not calculated";
+	else if (stages[s].external)
+		out << "set externally";
+	else if (current)
+		out << "current";
+	else
+		out << "stale";
+	return current;
+}
@@ -0,0 +1,50 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <string>
+#include <vector>
+#include <iostream>
+#include "fingerprint.h"
+
+class Pipeline {
+	/*
+	* The stages of the dose calculation, Bragg peaks and penumbra ->
+	* weights -> scan pattern -> dose -> normalised dose -> DVHs.  Each
+	* stage keeps the fingerprint of the inputs it was last computed
+	* from, which includes the results of the stages it uses, so it is
+	* only recomputed when one of them has changed.  Every result has a
+	* new id, unique across all engines, that later stages fingerprint.
+	* An external result (e.g. a dose read from an archive) is used as
+	* it is until it is recomputed.
+	*/
+	struct stage {
+		std::string name;
+		bool valid;
+		bool external;
+		size_t inputs;
+		size_t result;
+	};
+	std::vector<stage> stages;
+
+public:
+	static const int peaks = 0;
+	static const int penumbra = 1;
+	static const int weights = 2;
+	static const int pattern = 3;
+	static const int dose = 4;
+	static const int normalised = 5;
+	static const int histogram = 6;
+	static const int numberStages = 7;
+
+	Pipeline();
+	bool current(int s, size_t inputs) const;
+	bool computed(int s) const;
+	bool external(int s) const;
+	size_t result(int s) const;
+	void done(int s, size_t inputs);
+	void replaced(int s);
+	void invalidate(int s);
+	void copy(const Pipeline& from, int s);
+	bool status(int s, size_t inputs, bool upstream, std::ostream& out) const;
+
+};
+#endif
@@ -0,0 +1,114 @@
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <cmath>
+#include "doseMaps.h"
+#include "PeakTable.h"
+#include "RangeScenarios.h"
+
+void RangeScenarios::setNominal(std::shared_ptr<PeakTable> peaks, std::shared_ptr<map3D> penumbra) {
+	// The scaled tables are forgotten when the nominal tables are replaced
+	if (peaks != nominalPeaks || penumbra != nominalPenumbra)
+		scenarios.clear();
+	nominalPeaks = peaks;
+	nominalPenumbra = penumbra;
+}
+RangeScenarios::scaledTables& RangeScenarios::tables(double factor) {
+	// The tables of factor, made here if they are not cached
+	std::map<double, scaledTables>::iterator found = scenarios.find(factor);
+	if (found != scenarios.end())
+		return found->second;
+	scaledTables& scaled = scenarios[factor];
+	build(factor, &scaled, 0);
+	return scaled;
+}
+void RangeScenarios::build(double factor, scaledTables* entry, const std::vector<int>* ranges) {
+	/*
+	* Makes the tables of factor, stretching the peaks of ranges now,
+	* the others as they are used.
+	*/
+	scaledTables& scaled = *entry;
+	scaled.peaks.reset(new PeakTable);
+	scaled.peaks->scale(nominalPeaks, factor);
+	scaled.penumbra.reset(new map3D(scalePenumbra(*nominalPenumbra, factor)));
+	if (ranges) {
+		for (int r = 0; r < ranges->size(); r++)
+			scaled.peaks->curve((*ranges)[r]);
+	}
+}
+void RangeScenarios::prepare(const std::vector<double>& factors, const std::vector<int>& ranges, int threads) {
+	/*
+	* Makes the tables of every factor not already cached, with the
+	* peaks of ranges, using up to threads threads (0 for one per core).
+	*/
+	std::vector<double> todo;
+	std::vector<scaledTables*> entries;		/* Made before the threads start, the map is not changed by them */
+	for (int f = 0; f < factors.size(); f++) {
+		if (factors[f] > 0 && factors[f] != 1 && scenarios.find(factors[f]) == scenarios.end()) {
+			entries.push_back(&scenarios[factors[f]]);
+			todo.push_back(factors[f]);
+		}
+	}
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	for (int start = 0; start < todo.size(); start += threads) {
+		std::vector<std::thread> pool;
+		for (int f = start; f < todo.size() && f < start + threads; f++)
+			pool.push_back(std::thread(&RangeScenarios::build, this, todo[f], entries[f], &ranges));
+		for (int t = 0; t < pool.size(); t++)
+			pool[t].join();
+	}
+}
+std::shared_ptr<PeakTable> RangeScenarios::peaks(double factor) {
+	if (factor == 1)
+		return nominalPeaks;
+	return tables(factor).peaks;
+}
+std::shared_ptr<map3D> RangeScenarios::penumbra(double factor) {
+	if (factor == 1)
+		return nominalPenumbra;
+	return tables(factor).penumbra;
+}
+int RangeScenarios::size() const {
+	return scenarios.size();
+}
+map3D RangeScenarios::scalePenumbra(const map3D& penumbra, double factor) {
+	/*
+	* The penumbra at depth z is the nominal penumbra at z / factor,
+	* linear between mm and limited to the depths of the nominal table.
+	*/
+	map3D scaled;
+	if (penumbra.empty())
+		return scaled;
+	int minZ = penumbra.begin()->first;
+	int maxZ = penumbra.rbegin()->first;
+	int deepest = (int)ceil(maxZ * factor);
+	for (int z = minZ; z <= deepest; z++) {
+		double depth = z / factor;
+		if (depth < minZ) depth = minZ;
+		if (depth > maxZ) depth = maxZ;
+		int z0 = (int)depth;
+		double f = depth - z0;
+		map3D::const_iterator lower = penumbra.find(z0);
+		map3D::const_iterator upper = z0 < maxZ ? penumbra.find(z0 + 1) : lower;
+		if (lower == penumbra.end() || upper == penumbra.end())
+			continue;
+		map2D& plane = scaled[z];
+		for (map2D::const_iterator x = lower->second.begin(); x != lower->second.end(); x++) {
+			map2D::const_iterator xUpper = upper->second.find(x->first);
+			for (std::map<int, double>::const_iterator y = x->second.begin(); y != x->second.end(); y++) {
+				double next = y->second;
+				if (xUpper != upper->second.end()) {
+					std::map<int, double>::const_iterator yUpper = xUpper->second.find(y->first);
+					if (yUpper != xUpper->second.end())
+						next = yUpper->second;
+				}
+				plane[x->first][y->first] = (1 - f) * y->second + f * next;
+			}
+		}
+	}
+	return scaled;
+}
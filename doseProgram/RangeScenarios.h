@@ -0,0 +1,38 @@
+#ifndef RANGESCENARIOS_H
+#define RANGESCENARIOS_H
+#include <vector>
+#include <map>
+#include <memory>
+#include "doseMaps.h"
+#include "PeakTable.h"
+
+class RangeScenarios {
+	/*
+	* Bragg peaks and penumbra for range errors (range factors, e.g.
+	* 0.965 and 1.035 for +-3.5%), resampled in depth from the nominal
+	* tables instead of recalculated from modified Janni data.  The
+	* tables of every factor are kept until the nominal tables change.
+	* prepare() makes the tables of several factors in one pass, a
+	* thread per factor.
+	*/
+	struct scaledTables {
+		std::shared_ptr<PeakTable> peaks;
+		std::shared_ptr<map3D> penumbra;
+	};
+	std::shared_ptr<PeakTable> nominalPeaks;
+	std::shared_ptr<map3D> nominalPenumbra;
+	std::map<double, scaledTables> scenarios;
+
+	scaledTables& tables(double factor);
+	void build(double factor, scaledTables* entry, const std::vector<int>* ranges);
+
+public:
+	void setNominal(std::shared_ptr<PeakTable> peaks, std::shared_ptr<map3D> penumbra);
+	void prepare(const std::vector<double>& factors, const std::vector<int>& ranges, int threads = 0);
+	std::shared_ptr<PeakTable> peaks(double factor);
+	std::shared_ptr<map3D> penumbra(double factor);
+	int size() const;
+	static map3D scalePenumbra(const map3D& penumbra, double factor);
+
+};
+#endif
@@ -3,7 +3,7 @@
 #include "Motion.h"
 #include "spotPos.h"
 #include "scanSpeed.h"
-#include "scanPattern.h"
+#include "ScanPattern.h"
 #include <iostream>
 
 ScanPattern::ScanPattern() {
@@ -11,6 +11,8 @@ ScanPattern::ScanPattern() {
 	currentLayer = 0;
 	currentSpotNo = 0;
 	lastSpot.weight = -1;
+	speed.layerTime = 0;
+	speed.energyChangeTime = 0;
 }
 ScanPattern::ScanPattern(int xWidth, int yWidth, int zWidth, double spacing, std::map<int, double>& weights) {
 	lastSpot.weight = -1;
@@ -29,11 +31,18 @@ int ScanPattern::layerSize(int layerNumber) {
 	return spotPositions[layerNumber].size();
 }
 spotPos ScanPattern::getSpot(int layer, int spotNo) {
-	if (layer > layers || spotNo > spotPositions[layer].size())
+	if (layer >= layers || spotNo >= spotPositions[layer].size())
 		return lastSpot;
 	else
 		return spotPositions[layer][spotNo];
 }
+spotPos ScanPattern::getSpot(int layer, int painting, int spotNo) {
+	// The spot as delivered in one painting, moved by the motion at its delivery time
+	spotPos spot = getSpot(layer, spotNo);
+	if (spot.weight < 0 || motion.still())
+		return spot;
+	return motion.moveSpot(spot, spotTime(layer, painting, spotNo));
+}
 spotPos ScanPattern::getSpot() {
 	return spotPositions[currentLayer][currentSpotNo];
 //std::cout << "Layer Number : "<<currentLayer << " Spot No. " << currentSpotNo <<"\n";
@@ -44,7 +53,7 @@ spotPos ScanPattern::getNextSpot() {
 		currentLayer++;
 		currentSpotNo = 0;
 //std::cout << "Layer Number : "<<currentLayer << " Spot No. " << currentSpotNo <<"\n";
-		if (currentLayer > layers)
+		if (currentLayer >= layers)
 			return lastSpot;
 		else
 			return spotPositions[currentLayer][currentSpotNo];
@@ -54,9 +63,41 @@ spotPos ScanPattern::getNextSpot() {
 		return spotPositions[currentLayer][currentSpotNo];
 	}
 }
+int ScanPattern::paintings(int layer) {
+	// Number of times the layer is painted, each painting delivers 1/paintings of the spot weights
+	if (layer < speed.noPaintings.size() && speed.noPaintings[layer] > 0)
+		return speed.noPaintings[layer];
+	return 1;
+}
+double ScanPattern::layerStart(int layer) {
+	// Time (s) the first painting of layer starts, layers are delivered in order
+	double time = 0;
+	for (int l = 0; l < layer && l < layers; l++)
+		time += paintings(l) * speed.layerTime + speed.energyChangeTime;
+	return time;
+}
+double ScanPattern::spotTime(int layer, int painting, int spotNo) {
+	/*
+	* Delivery time (s) of a spot in one painting of a layer, the spots
+	* of a painting are spread evenly over layerTime.
+	*/
+	return layerStart(layer) + (painting + (spotNo + 0.5) / layerSize(layer)) * speed.layerTime;
+}
+double ScanPattern::deliveryTime() {
+	// Time (s) to deliver the whole pattern
+	if (layers == 0)
+		return 0;
+	return layerStart(layers - 1) + paintings(layers - 1) * speed.layerTime;
+}
 void ScanPattern::setMotion(Motion motionInput) {
 	motion = motionInput;
 }
+const Motion& ScanPattern::getMotion() const {
+	return motion;
+}
+bool ScanPattern::moving() const {
+	return !motion.still();
+}
 void ScanPattern::setScanSpeed(scanSpeed speedInput) {
 	speed = speedInput;
 }
@@ -91,6 +132,11 @@ void ScanPattern::defineScanPattern() {
 	}
 //std::cout << "\nNumber of spots: "<< spotPositions[255].size();
 }
+void ScanPattern::addLayer(const std::vector<spotPos>& spots) {
+	// Adds a layer delivered after the others
+	spotPositions[layers] = spots;
+	layers++;
+}
 void ScanPattern::defineScanPattern(int xWidth, int yWidth, int zWidth, double spacing, std::map<int, double>& weights) {
 	int temp;
 }
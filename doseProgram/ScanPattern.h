@@ -23,11 +23,19 @@ public:
 	int numberLayers();
 	int layerSize(int layerNumber);
 	spotPos getSpot(int layer, int spotNo);
+	spotPos getSpot(int layer, int painting, int spotNo);
 	spotPos getSpot();
 	spotPos getNextSpot();
+	int paintings(int layer);
+	double layerStart(int layer);
+	double spotTime(int layer, int painting, int spotNo);
+	double deliveryTime();
 	void setMotion(Motion motionInput);
+	const Motion& getMotion() const;
+	bool moving() const;
 	void setScanSpeed(scanSpeed speedInput);
 	void defineScanPattern();
+	void addLayer(const std::vector<spotPos>& spots);
 	void defineScanPattern(int xWidth, int yWidth, int zWidth, double spacing, std::map<int, double>& weights);
 
 };
@@ -0,0 +1,216 @@
+#include <string>
+#include <vector>
+#include <istream>
+#include <iostream>
+#include <cmath>
+#include "DoseGrid.h"
+#include "Structure.h"
+
+Structure::Structure(std::string name) {
+	label = name;
+}
+std::string Structure::name() const {
+	return label;
+}
+void Structure::add(char op, std::string type, const double p[6]) {
+	roiShape shape;
+	shape.op = op;
+	shape.type = type;
+	for (int i = 0; i < 6; i++)
+		shape.p[i] = p ? p[i] : 0;
+	shapes.push_back(shape);
+	geometry.clear();
+}
+bool Structure::read(std::istream& in, const std::vector<Structure>& earlier) {
+	/*
+	* Reads "op type parameters" of one shape, e.g. "+ box -30 -30 120
+	* 30 30 180", "- sphere 0 0 150 10", "+ all" or "- target".  Any
+	* other type must name a structure before this one in earlier.
+	*/
+	std::string op, type;
+	in >> op >> type;
+	if (!in || (op != "+" && op != "-"))
+		return false;
+	if (type != "box" && type != "ellipsoid" && type != "sphere" && type != "all") {
+		int s = 0;
+		while (s < earlier.size() && &earlier[s] != this && earlier[s].name() != type)
+			s++;
+		if (s == earlier.size() || &earlier[s] == this) {
+			std::cout << "\nUnknown shape or structure " << type << ", structures must be defined before they are used";
+			return false;
+		}
+	}
+	double p[6] = {0, 0, 0, 0, 0, 0};
+	int count = 0;
+	if (type == "box" || type == "ellipsoid")
+		count = 6;
+	else if (type == "sphere")
+		count = 4;
+	for (int i = 0; i < count; i++)
+		in >> p[i];
+	if (!in)
+		return false;
+	if (type == "sphere") {
+		p[4] = p[3];
+		p[5] = p[3];
+	}
+	add(op[0], type == "sphere" ? "ellipsoid" : type, p);
+	return true;
+}
+std::vector<double> Structure::shapeOf(const DoseGrid& grid) {
+	// The voxel size, corner and size of every level
+	std::vector<double> shape;
+	for (int l = 0; l < grid.numberLevels(); l++) {
+		const gridLevel& level = grid.level(l);
+		shape.push_back(level.voxelSize);
+		for (int a = 0; a < 3; a++) {
+			shape.push_back(level.corner[a]);
+			shape.push_back(level.n[a]);
+			shape.push_back(level.hole[0][a]);
+			shape.push_back(level.hole[1][a]);
+		}
+	}
+	return shape;
+}
+std::vector<size_t> Structure::shapeSpans(const DoseGrid& grid, int l, const roiShape& shape, const std::vector<Structure>& earlier) const {
+	/*
+	* Runs of voxels on level l with centres inside one shape, found
+	* column by column from the z extent of the shape at the centre of
+	* the column.
+	*/
+	std::vector<size_t> spans;
+	if (shape.type != "box" && shape.type != "ellipsoid" && shape.type != "all") {
+		for (int s = 0; s < earlier.size() && &earlier[s] != this; s++) {
+			if (earlier[s].name() == shape.type && earlier[s].numberLevels() > l)
+				return earlier[s].spans(l);
+		}
+		return spans;
+	}
+	if (shape.type == "ellipsoid" && (shape.p[3] <= 0 || shape.p[4] <= 0 || shape.p[5] <= 0))
+		return spans;
+	const gridLevel& level = grid.level(l);
+	for (int i = 0; i < level.n[0]; i++) {
+		double x = level.position(0, i);
+		for (int j = 0; j < level.n[1]; j++) {
+			double y = level.position(1, j);
+			int first = 0;
+			int last = level.n[2];
+			if (shape.type == "box") {
+				if (x < shape.p[0] || x >= shape.p[3] || y < shape.p[1] || y >= shape.p[4])
+					continue;
+				level.range(2, shape.p[2], shape.p[5], first, last);
+			}
+			else if (shape.type == "ellipsoid") {
+				double dx = (x - shape.p[0]) / shape.p[3];
+				double dy = (y - shape.p[1]) / shape.p[4];
+				double t = 1 - dx * dx - dy * dy;
+				if (t < 0)
+					continue;
+				double dz = shape.p[5] * sqrt(t);
+				level.range(2, shape.p[2] - dz, shape.p[2] + dz + 1e-9, first, last);
+			}
+			if (first < last) {
+				spans.push_back(level.index(i, j, first));
+				spans.push_back(level.index(i, j, last));
+			}
+		}
+	}
+	return spans;
+}
+void Structure::build(const DoseGrid& grid, const std::vector<Structure>& earlier) {
+	/*
+	* Builds the runs on grid, structures named by shapes must be
+	* before this one in earlier and already built.  Voxels covered by a finer level are
+	* removed.
+	*/
+	spanList.assign(grid.numberLevels(), std::vector<size_t>());
+	for (int l = 0; l < grid.numberLevels(); l++) {
+		std::vector<size_t>& spans = spanList[l];
+		for (int s = 0; s < shapes.size(); s++) {
+			std::vector<size_t> shape = shapeSpans(grid, l, shapes[s], earlier);
+			spans = shapes[s].op == '-' ? subtract(spans, shape) : unite(spans, shape);
+		}
+		const gridLevel& level = grid.level(l);
+		std::vector<size_t> hole;
+		for (int i = level.hole[0][0]; i < level.hole[1][0]; i++) {
+			for (int j = level.hole[0][1]; j < level.hole[1][1]; j++) {
+				hole.push_back(level.index(i, j, level.hole[0][2]));
+				hole.push_back(level.index(i, j, level.hole[1][2]));
+			}
+		}
+		if (!hole.empty())
+			spans = subtract(spans, hole);
+	}
+	geometry = shapeOf(grid);
+}
+bool Structure::matches(const DoseGrid& grid) const {
+	// True if the runs were built for a grid of the same shape
+	return !geometry.empty() && geometry == shapeOf(grid);
+}
+int Structure::numberLevels() const {
+	return spanList.size();
+}
+const std::vector<size_t>& Structure::spans(int level) const {
+	return spanList[level];
+}
+size_t Structure::voxels() const {
+	size_t count = 0;
+	for (int l = 0; l < spanList.size(); l++) {
+		for (size_t s = 0; s < spanList[l].size(); s += 2)
+			count += spanList[l][s + 1] - spanList[l][s];
+	}
+	return count;
+}
+std::vector<size_t> Structure::unite(const std::vector<size_t>& a, const std::vector<size_t>& b) {
+	// Union of two sorted lists of [start, end) runs
+	std::vector<size_t> result;
+	size_t i = 0, j = 0;
+	while (i < a.size() || j < b.size()) {
+		size_t start, end;
+		if (j >= b.size() || (i < a.size() && a[i] <= b[j])) {
+			start = a[i];
+			end = a[i + 1];
+			i += 2;
+		}
+		else {
+			start = b[j];
+			end = b[j + 1];
+			j += 2;
+		}
+		if (!result.empty() && start <= result.back()) {
+			if (end > result.back())
+				result.back() = end;
+		}
+		else {
+			result.push_back(start);
+			result.push_back(end);
+		}
+	}
+	return result;
+}
+std::vector<size_t> Structure::subtract(const std::vector<size_t>& a, const std::vector<size_t>& b) {
+	// Runs of a that are not in b, both sorted
+	std::vector<size_t> result;
+	size_t j = 0;
+	for (size_t i = 0; i < a.size(); i += 2) {
+		size_t start = a[i];
+		size_t end = a[i + 1];
+		while (j < b.size() && b[j + 1] <= start)
+			j += 2;
+		size_t k = j;
+		while (k < b.size() && b[k] < end) {
+			if (b[k] > start) {
+				result.push_back(start);
+				result.push_back(b[k]);
+			}
+			if (b[k + 1] > start)
+				start = b[k + 1];
+			k += 2;
+		}
+		if (start < end) {
+			result.push_back(start);
+			result.push_back(end);
+		}
+	}
+	return result;
+}
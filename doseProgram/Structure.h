@@ -0,0 +1,52 @@
+#ifndef STRUCTURE_H
+#define STRUCTURE_H
+#include <string>
+#include <vector>
+#include <istream>
+#include "DoseGrid.h"
+
+struct roiShape {
+	/*
+	* One shape added to (op '+') or removed from (op '-') a structure:
+	* "box" (x, y, z of the lower and upper corners), "sphere" (centre
+	* and radius), "ellipsoid" (centre and radii), "all" (the whole
+	* phantom), or any other word is the name of an earlier structure.
+	*/
+	char op;
+	std::string type;
+	double p[6];
+};
+
+class Structure {
+	/*
+	* A region of interest (target, organ at risk, tissue) on a dose
+	* grid.  It is defined by shapes and stored as runs of voxels along
+	* z, the fastest axis, as [start, end) voxel indices on each level.
+	* Voxels covered by a finer level are never included, so every point
+	* is in at most one voxel.  The runs are rebuilt by build() when the
+	* grid changes and are shared by every scenario on that grid.
+	*/
+	std::string label;
+	std::vector<roiShape> shapes;
+	std::vector<double> geometry;					/* Levels of the grid the spans were built for */
+	std::vector<std::vector<size_t> > spanList;		/* spanList[l] is start, end pairs on level l */
+
+	std::vector<size_t> shapeSpans(const DoseGrid& grid, int l, const roiShape& shape, const std::vector<Structure>& earlier) const;
+	static std::vector<double> shapeOf(const DoseGrid& grid);
+
+public:
+	Structure(std::string name = "");
+	std::string name() const;
+	void add(char op, std::string type, const double p[6]);
+	bool read(std::istream& in, const std::vector<Structure>& earlier);
+	void build(const DoseGrid& grid, const std::vector<Structure>& earlier);
+	bool matches(const DoseGrid& grid) const;
+	int numberLevels() const;
+	const std::vector<size_t>& spans(int level) const;
+	size_t voxels() const;
+
+	static std::vector<size_t> unite(const std::vector<size_t>& a, const std::vector<size_t>& b);
+	static std::vector<size_t> subtract(const std::vector<size_t>& a, const std::vector<size_t>& b);
+
+};
+#endif
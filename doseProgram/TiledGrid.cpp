@@ -0,0 +1,189 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "DoseGrid.h"
+#include "TiledGrid.h"
+
+TiledGrid::TiledGrid() {
+	file = -1;
+	tileWidth = 1;
+	slabSize = 0;
+	resident = 0;
+	maxResident = 0;
+}
+TiledGrid::~TiledGrid() {
+	close();
+}
+bool TiledGrid::create(std::string name, int phantomSize, double voxelSize, double tileMB) {
+	/*
+	* Creates the file for a grid of voxelSize over the whole phantom,
+	* replacing any file of the same name, with all doses 0.  Tiles are
+	* as wide as fits in tileMB, at least one slab.  The file is sparse
+	* until doses are added.
+	*/
+	close();
+	fileName = name;
+	layout.defineShape(phantomSize, voxelSize);
+	const gridLevel& shape = layout.level(0);
+	slabSize = (size_t)shape.n[1] * shape.n[2];
+	tileWidth = (int)(tileMB * 1048576 / (slabSize * sizeof(double)));
+	if (tileWidth < 1)
+		tileWidth = 1;
+	if (tileWidth > shape.n[0])
+		tileWidth = shape.n[0];
+	int tiles = (shape.n[0] + tileWidth - 1) / tileWidth;
+	mapped.assign(tiles, 0);
+	mappedBytes.assign(tiles, 0);
+	this->tiles.assign(tiles, 0);
+	resident = 0;
+	maxResident = 0;
+	file = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+		return false;
+	if (ftruncate(file, (off_t)(shape.n[0] * slabSize * sizeof(double))) != 0) {
+		close();
+		return false;
+	}
+	return true;
+}
+void TiledGrid::close() {
+	// Writes back and unmaps every tile, the file is kept
+	releaseAll();
+	if (file >= 0)
+		::close(file);
+	file = -1;
+}
+bool TiledGrid::isOpen() const {
+	return file >= 0;
+}
+const DoseGrid& TiledGrid::grid() const {
+	return layout;
+}
+const gridLevel& TiledGrid::level() const {
+	return layout.level(0);
+}
+int TiledGrid::numberTiles() const {
+	return tiles.size();
+}
+int TiledGrid::tileOf(int i) const {
+	return i / tileWidth;
+}
+size_t TiledGrid::firstVoxel(int t) const {
+	return (size_t)t * tileWidth * slabSize;
+}
+size_t TiledGrid::tileVoxels(int t) const {
+	// Voxels in tile t, the last tile may be narrower
+	return (size_t)std::min(tileWidth, level().n[0] - t * tileWidth) * slabSize;
+}
+double TiledGrid::tileMB() const {
+	return (double)tileWidth * slabSize * sizeof(double) / 1048576;
+}
+double* TiledGrid::tile(int t) {
+	/*
+	* The doses of tile t, mapping it if it is not in memory.  Mappings
+	* start on a page boundary so may include the end of the tile
+	* before.  Returns 0 if the tile cannot be mapped.
+	*/
+	if (tiles[t])
+		return tiles[t];
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t offset = firstVoxel(t) * sizeof(double);
+	size_t start = offset - offset % page;
+	size_t bytes = tileVoxels(t) * sizeof(double) + offset - start;
+	void* memory = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, (off_t)start);
+	if (memory == MAP_FAILED) {
+		std::cout << "\nERROR mapping tile " << t << " of " << fileName;
+		return 0;
+	}
+	mapped[t] = (char*)memory;
+	mappedBytes[t] = bytes;
+	tiles[t] = (double*)(mapped[t] + offset - start);
+	resident++;
+	if (resident > maxResident)
+		maxResident = resident;
+	return tiles[t];
+}
+void TiledGrid::release(int t) {
+	// Unmaps tile t, its doses are written back to the file
+	if (!tiles[t])
+		return;
+	munmap(mapped[t], mappedBytes[t]);
+	mapped[t] = 0;
+	tiles[t] = 0;
+	resident--;
+}
+void TiledGrid::releaseAll() {
+	for (int t = 0; t < tiles.size(); t++)
+		release(t);
+}
+int TiledGrid::maxTiles() const {
+	// Most tiles that have been in memory at once
+	return maxResident;
+}
+double* TiledGrid::column(int i, int j) {
+	// The doses along z of voxel column (i, j), mapping its tile
+	int t = tileOf(i);
+	double* doses = tile(t);
+	if (!doses)
+		return 0;
+	return doses + ((size_t)(i - t * tileWidth) * level().n[1] + j) * level().n[2];
+}
+double TiledGrid::maxDose() {
+	// Maximum dose, reading one tile at a time
+	double max = 0;
+	for (int t = 0; t < tiles.size(); t++) {
+		bool wasMapped = tiles[t] != 0;
+		double* doses = tile(t);
+		if (!doses)
+			continue;
+		for (size_t v = 0; v < tileVoxels(t); v++) {
+			if (doses[v] > max)
+				max = doses[v];
+		}
+		if (!wasMapped)
+			release(t);
+	}
+	return max;
+}
+void TiledGrid::scale(double factor) {
+	// Multiplies every dose by factor, one tile at a time
+	for (int t = 0; t < tiles.size(); t++) {
+		bool wasMapped = tiles[t] != 0;
+		double* doses = tile(t);
+		if (!doses)
+			continue;
+		for (size_t v = 0; v < tileVoxels(t); v++)
+			doses[v] *= factor;
+		if (!wasMapped)
+			release(t);
+	}
+}
+bool TiledGrid::plane(double z, std::vector<double>& values) {
+	/*
+	* values[i * n[1] + j] is set to the dose of the voxels nearest
+	* depth z (mm), read one tile at a time.  Returns false if z is
+	* outside the grid.
+	*/
+	const gridLevel& shape = level();
+	int k = (int)floor((z - shape.corner[2]) / shape.voxelSize + 0.5);
+	if (k < 0 || k >= shape.n[2])
+		return false;
+	values.assign((size_t)shape.n[0] * shape.n[1], 0);
+	for (int t = 0; t < tiles.size(); t++) {
+		bool wasMapped = tiles[t] != 0;
+		if (!tile(t))
+			return false;
+		for (int i = t * tileWidth; i < shape.n[0] && i < (t + 1) * tileWidth; i++) {
+			for (int j = 0; j < shape.n[1]; j++)
+				values[(size_t)i * shape.n[1] + j] = column(i, j)[k];
+		}
+		if (!wasMapped)
+			release(t);
+	}
+	return true;
+}
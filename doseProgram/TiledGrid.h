@@ -0,0 +1,58 @@
+#ifndef TILEDGRID_H
+#define TILEDGRID_H
+#include <string>
+#include <vector>
+#include "DoseGrid.h"
+
+class TiledGrid {
+	/*
+	* A uniform dose grid too large for memory, held in a memory mapped
+	* file.  The grid is cut into tiles, slabs of tileWidth voxels in x,
+	* the slowest axis, so each tile is one contiguous part of the file.
+	* A tile is mapped the first time it is used and stays in memory
+	* until it is released, the dose calculation adds spots in order of
+	* x and releases the tiles behind them.  Everything that reads the
+	* whole grid goes through it a tile at a time.
+	*
+	* Layout: the doses as double in the order of gridLevel::index(),
+	* in the byte order of the machine.  The file is kept after close(),
+	* it is the whole dose distribution.
+	*/
+	std::string fileName;
+	int file;
+	DoseGrid layout;					/* The voxels of the grid, without doses */
+	int tileWidth;						/* Voxels in x of each tile */
+	size_t slabSize;					/* Voxels in one slab of constant x */
+	std::vector<char*> mapped;			/* Start of the mapping of each tile, 0 if not mapped */
+	std::vector<size_t> mappedBytes;
+	std::vector<double*> tiles;			/* First voxel of each mapped tile */
+	int resident;
+	int maxResident;
+
+	size_t tileVoxels(int t) const;
+	TiledGrid(const TiledGrid&);
+	TiledGrid& operator=(const TiledGrid&);
+
+public:
+	TiledGrid();
+	~TiledGrid();
+	bool create(std::string fileName, int phantomSize, double voxelSize, double tileMB);
+	void close();
+	bool isOpen() const;
+	const DoseGrid& grid() const;
+	const gridLevel& level() const;
+	int numberTiles() const;
+	int tileOf(int i) const;
+	size_t firstVoxel(int t) const;
+	double tileMB() const;
+	double* tile(int t);
+	void release(int t);
+	void releaseAll();
+	int maxTiles() const;
+	double* column(int i, int j);
+	double maxDose();
+	void scale(double factor);
+	bool plane(double z, std::vector<double>& values);
+
+};
+#endif
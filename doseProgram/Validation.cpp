@@ -0,0 +1,304 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include "doseMaps.h"
+#include "ScanPattern.h"
+#include "janniTables.h"
+#include "PeakTable.h"
+#include "DoseGrid.h"
+#include "KernelCache.h"
+#include "Structure.h"
+#include "doseCalc.h"
+#include "referenceCalc.h"
+#include "Validation.h"
+
+static const char* stageNames[4] = {"peaks", "penumbra", "dose", "histogram"};
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Validation::Validation() {
+	/*
+	* The default suite, two phantoms and patterns on 1 mm voxels and
+	* one on uniform 0.5 mm voxels, where both backends sample the same
+	* points, and one with 0.5 mm voxels over the target inside 1 mm
+	* voxels.  The DVH of 0.5 mm voxels counts 8 voxels for each point
+	* of the reference, just over 2% volume apart.  The fine voxels of
+	* the last case are between the mm of the reference, so the
+	* penumbra is interpolated between the mm it is tabulated at, its
+	* tolerances are this discretisation, just under 4% and 21% of the
+	* dose at the sharpest penumbra of its target.  Deep peaks are used
+	* as the penumbra is wider there.
+	*/
+	validationCase c = {100, 20, 5, 1, 1, 50, 60, 5, 10, 5, 0, 0, 0, 0};
+	cases.push_back(c);
+	validationCase shallow = {60, 20, 0, 1, 1, 20, 30, 10, 5, 5, 0, 0, 0, 0};
+	cases.push_back(shallow);
+	validationCase fine = {60, 20, 0, 0.5, 0.5, 20, 30, 10, 5, 5, 0, 0, 2.5, 0};
+	cases.push_back(fine);
+	validationCase levels = {240, 20, 5, 0.5, 1, 200, 210, 10, 5, 5, 5, 0.25, 5, 0};
+	cases.push_back(levels);
+	setThreshold(peaks, 1e-6, 1e-8);
+	setThreshold(penumbra, 1e-6, 1e-8);
+	setThreshold(dose, 0.1, 0.001);
+	setThreshold(histogram, 0.5, 0);
+	minSpeedup = 0;
+}
+void Validation::addCase(const validationCase& c) {
+	cases.push_back(c);
+}
+void Validation::setThreshold(int stage, double absError, double relError) {
+	// A relative error of 0 is not checked
+	maxAbs[stage] = absError;
+	maxRel[stage] = relError;
+}
+void Validation::setSpeedup(double speedup) {
+	minSpeedup = speedup;
+}
+bool Validation::read(std::string fileName) {
+	/*
+	* Reads a suite, one entry per line, lines starting with # are
+	* ignored:
+	*   case phantomSize size margin voxelSize coarseVoxelSize
+	*        firstRange lastRange rangeStep halfWidth spacing
+	*        [doseTolerance doseRelTolerance
+	*        histogramTolerance histogramRelTolerance]
+	*   threshold stage maxAbs maxRel
+	*   speedup minimum
+	* The cases replace the default suite, thresholds not given keep
+	* their defaults.
+	*/
+	std::ifstream inFile(fileName.c_str());
+	if (!inFile)
+		return false;
+	std::vector<validationCase> suite;
+	std::string line;
+	while (std::getline(inFile, line)) {
+		std::istringstream in(line);
+		std::string type;
+		if (!(in >> type) || type[0] == '#')
+			continue;
+		if (type == "case") {
+			validationCase c;
+			in >> c.phantomSize >> c.size >> c.margin >> c.voxelSize >> c.coarseVoxelSize
+				>> c.firstRange >> c.lastRange >> c.rangeStep >> c.halfWidth >> c.spacing;
+			if (!in || c.voxelSize <= 0 || !DoseGrid::nests(c.coarseVoxelSize, c.voxelSize) || c.rangeStep < 1 || c.spacing < 1 || c.firstRange > c.lastRange) {
+				std::cout << "\nError in validation case: " << line;
+				return false;
+			}
+			double tolerance[4] = {0, 0, 0, 0};
+			for (int t = 0; t < 4 && in; t++)
+				in >> tolerance[t];
+			c.doseTolerance = tolerance[0];
+			c.doseRelTolerance = tolerance[1];
+			c.histogramTolerance = tolerance[2];
+			c.histogramRelTolerance = tolerance[3];
+			suite.push_back(c);
+		}
+		else if (type == "threshold") {
+			std::string stage;
+			double absError, relError;
+			in >> stage >> absError >> relError;
+			int s = 0;
+			while (s < 4 && stage != stageNames[s])
+				s++;
+			if (!in || s == 4) {
+				std::cout << "\nError in validation threshold: " << line;
+				return false;
+			}
+			setThreshold(s, absError, relError);
+		}
+		else if (type == "speedup") {
+			if (!(in >> minSpeedup)) {
+				std::cout << "\nError in validation speedup: " << line;
+				return false;
+			}
+		}
+		else {
+			std::cout << "\nUnknown validation entry: " << line;
+			return false;
+		}
+	}
+	if (!suite.empty())
+		cases = suite;
+	return true;
+}
+ScanPattern Validation::pattern(const validationCase& c) const {
+	// A layer of spots for each range, all with weight 1
+	ScanPattern SP;
+	for (int z = c.firstRange; z <= c.lastRange; z += c.rangeStep) {
+		std::vector<spotPos> layer;
+		spotPos spot;
+		spot.z = z;
+		spot.weight = 1;
+		for (spot.y = -c.halfWidth; spot.y <= c.halfWidth; spot.y += c.spacing) {
+			for (spot.x = -c.halfWidth; spot.x <= c.halfWidth; spot.x += c.spacing)
+				layer.push_back(spot);
+		}
+		SP.addLayer(layer);
+	}
+	return SP;
+}
+bool Validation::result(std::ostream& report, int stage, double absError, double relError, double referenceTime, double fastTime, double absTolerance, double relTolerance) {
+	// One line of the report, returns true if the stage passed, a tolerance above 0 replaces that threshold of the stage
+	double absLimit = absTolerance > 0 ? absTolerance : maxAbs[stage];
+	double relLimit = relTolerance > 0 ? relTolerance : maxRel[stage];
+	bool pass = absError <= absLimit && (relLimit <= 0 || relError <= relLimit);
+	report << stageNames[stage] << "\t" << absError << "\t" << relError << "\t" << referenceTime << "\t" << fastTime
+		<< "\t" << (fastTime > 0 ? referenceTime / fastTime : 0) << "\t" << (pass ? "pass" : "FAIL") << "\n";
+	return pass;
+}
+bool Validation::runCase(const validationCase& c, const janniTables& janniData, double sd, std::ostream& report) {
+	/*
+	* Calculates one case with both backends, the peaks cover the
+	* ranges of the pattern and the penumbra every depth a spot reaches.
+	*/
+	bool pass = true;
+	int maxDepth = c.lastRange + KernelCache::peakTail;
+	double referenceTotal = 0;
+	double fastTotal = 0;
+	report << "\ncase\t" << c.phantomSize << "\t" << c.size << "\t" << c.margin << "\t" << c.voxelSize << "\t" << c.coarseVoxelSize
+		<< "\t" << c.firstRange << "\t" << c.lastRange << "\t" << c.rangeStep << "\t" << c.halfWidth << "\t" << c.spacing << "\n";
+	report << "stage\tmaxAbs\tmaxRel\treference(s)\tfast(s)\tspeedup\tresult\n";
+
+	/* Bragg peaks, errors in % of the maximum of each peak */
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	map2D referenceBragg = referencePeaks(janniData, c.firstRange, c.lastRange + 1, sd);
+	double referenceTime = seconds(start);
+	start = std::chrono::steady_clock::now();
+	PeakTable fastBragg;
+	fastBragg.configure(c.firstRange, c.lastRange + 1, sd, janniData);
+	for (int r = c.firstRange; r <= c.lastRange; r += c.rangeStep)
+		fastBragg.curve(r);
+	double fastTime = seconds(start);
+	double absError = 0;
+	double relError = 0;
+	for (int r = c.firstRange; r <= c.lastRange; r += c.rangeStep) {
+		std::map<int, double>& peak = referenceBragg[r];
+		double max = 0;
+		for (std::map<int, double>::iterator z = peak.begin(); z != peak.end(); z++)
+			max = std::max(max, z->second);
+		for (std::map<int, double>::iterator z = peak.begin(); z != peak.end(); z++) {
+			double error = fabs(fastBragg.dose(r, z->first) - z->second);
+			absError = std::max(absError, 100 * error / max);
+			if (z->second > 0.01 * max)
+				relError = std::max(relError, error / z->second);
+		}
+	}
+	pass &= result(report, peaks, absError, relError, referenceTime, fastTime);
+	referenceTotal += referenceTime;
+	fastTotal += fastTime;
+
+	/* Penumbra, normalised to 1 on the axis */
+	start = std::chrono::steady_clock::now();
+	map3D referenceProfile = referencePenumbra(janniData, maxDepth);
+	referenceTime = seconds(start);
+	start = std::chrono::steady_clock::now();
+	map3D fastProfile = calcPenumbra(janniData, maxDepth);
+	fastTime = seconds(start);
+	absError = 0;
+	relError = 0;
+	for (int z = 1; z <= maxDepth; z++) {
+		for (int x = 0; x <= penumbraCutoff; x++) {
+			for (int y = 0; y <= penumbraCutoff; y++) {
+				double value = referenceProfile[z][x][y];
+				double error = fabs(fastProfile[z][x][y] - value);
+				absError = std::max(absError, 100 * error);
+				if (value > 0.01)
+					relError = std::max(relError, error / value);
+			}
+		}
+	}
+	pass &= result(report, penumbra, absError, relError, referenceTime, fastTime);
+	referenceTotal += referenceTime;
+	fastTotal += fastTime;
+
+	/* Dose normalised to 100% by both, compared at every mm of the phantom */
+	ScanPattern SP = pattern(c);
+	start = std::chrono::steady_clock::now();
+	map3D referencePhantom;
+	referenceDose(referencePhantom, SP, referenceBragg, referenceProfile);
+	referenceNormalise(referencePhantom, c.phantomSize);
+	referenceTime = seconds(start);
+	start = std::chrono::steady_clock::now();
+	DoseGrid fastPhantom;
+	std::vector<KernelCache> kernels;
+	std::vector<int> none(3);
+	defineGrid(fastPhantom, c.phantomSize, c.size, c.margin, c.voxelSize, c.coarseVoxelSize);
+	calculateDose(fastPhantom, SP, fastBragg, fastProfile, 0, kernels, none);
+	normalise(fastPhantom);
+	fastTime = seconds(start);
+	absError = 0;
+	relError = 0;
+	for (map3D::iterator x = referencePhantom.begin(); x != referencePhantom.end(); x++) {
+		if (2 * x->first < -c.phantomSize || 2 * x->first >= c.phantomSize)
+			continue;
+		for (map2D::iterator y = x->second.begin(); y != x->second.end(); y++) {
+			if (2 * y->first < -c.phantomSize || 2 * y->first >= c.phantomSize)
+				continue;
+			for (std::map<int, double>::iterator z = y->second.begin(); z != y->second.end(); z++) {
+				if (z->first >= c.phantomSize)
+					continue;
+				double error = fabs(fastPhantom.interpolateAt(x->first, y->first, z->first) - z->second);
+				absError = std::max(absError, error);
+				if (z->second > 1)
+					relError = std::max(relError, error / z->second);
+			}
+		}
+	}
+	pass &= result(report, dose, absError, relError, referenceTime, fastTime, c.doseTolerance, c.doseRelTolerance);
+	referenceTotal += referenceTime;
+	fastTotal += fastTime;
+
+	/* Target DVH, errors in % of the target volume */
+	start = std::chrono::steady_clock::now();
+	std::vector<double> maxMin;
+	std::vector<int> referenceDVH = referenceDoseVol(referencePhantom, c.size, c.phantomSize, maxMin);
+	referenceTime = seconds(start);
+	start = std::chrono::steady_clock::now();
+	double box[6];
+	targetBox(c.size, c.phantomSize, none, box, box + 3);
+	std::vector<Structure> structures(1, Structure("target"));
+	structures[0].add('+', "box", box);
+	structures[0].build(fastPhantom, structures);
+	std::vector<double> stats;
+	std::vector<int> fastDVH = doseVolume(fastPhantom, structures[0], none, stats);
+	fastTime = seconds(start);
+	absError = 0;
+	relError = 0;
+	for (int i = 0; i < referenceDVH.size() && i < fastDVH.size(); i++) {
+		double referenceVolume = referenceDVH[0] > 0 ? 100.0 * referenceDVH[i] / referenceDVH[0] : 0;
+		double fastVolume = fastDVH[0] > 0 ? 100.0 * fastDVH[i] / fastDVH[0] : 0;
+		absError = std::max(absError, fabs(fastVolume - referenceVolume));
+		if (referenceVolume > 1)
+			relError = std::max(relError, fabs(fastVolume - referenceVolume) / referenceVolume);
+	}
+	pass &= result(report, histogram, absError, relError, referenceTime, fastTime, c.histogramTolerance, c.histogramRelTolerance);
+	referenceTotal += referenceTime;
+	fastTotal += fastTime;
+
+	double speedup = fastTotal > 0 ? referenceTotal / fastTotal : 0;
+	bool fastEnough = minSpeedup <= 0 || speedup >= minSpeedup;
+	report << "total\t\t\t" << referenceTotal << "\t" << fastTotal << "\t" << speedup << "\t" << (fastEnough ? "pass" : "FAIL") << "\n";
+	return pass && fastEnough;
+}
+bool Validation::run(const janniTables& janniData, double sd, std::ostream& report) {
+	/*
+	* Runs every case of the suite, writing a table of the errors and
+	* times of each stage to report.  Returns false if any stage of any
+	* case failed.
+	*/
+	bool pass = true;
+	report << "# maxAbs: % of the reference maximum (dose: %, histogram: % volume), maxRel: where the reference is > 1% of its maximum\n";
+	for (int c = 0; c < cases.size(); c++) {
+		if (!runCase(cases[c], janniData, sd, report))
+			pass = false;
+	}
+	report << "\n" << (pass ? "PASS" : "FAIL") << "\n";
+	return pass;
+}
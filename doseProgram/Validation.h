@@ -0,0 +1,67 @@
+#ifndef VALIDATION_H
+#define VALIDATION_H
+#include <string>
+#include <vector>
+#include <iostream>
+#include "doseMaps.h"
+#include "ScanPattern.h"
+#include "janniTables.h"
+
+struct validationCase {
+	/*
+	* One phantom and scan pattern of a validation suite, layers from
+	* firstRange to lastRange every rangeStep mm with spots every
+	* spacing mm up to halfWidth from the beam axis.  Grids that do not
+	* sample the reference at every mm have their own dose and DVH
+	* tolerances, each 0 to use the threshold of the suite.
+	*/
+	int phantomSize;
+	int size;					/* Target size */
+	int margin;
+	double voxelSize;
+	double coarseVoxelSize;
+	int firstRange;
+	int lastRange;
+	int rangeStep;
+	int halfWidth;
+	int spacing;
+	double doseTolerance;		/* Maximum absolute error of the dose (%) */
+	double doseRelTolerance;	/* Maximum relative error of the dose */
+	double histogramTolerance;	/* Maximum absolute error of the DVH (% volume) */
+	double histogramRelTolerance;
+};
+
+class Validation {
+	/*
+	* Runs the optimised calculation (PeakTable, calcPenumbra, addSpot
+	* and calcDoseVol) side by side with the original map based one in
+	* referenceCalc on a suite of phantoms and scan patterns.  For each
+	* stage the maximum absolute error (% of the reference maximum, % of
+	* the volume for the DVH), the maximum relative error (where the
+	* reference is above 1% of its maximum) and the speedup are
+	* reported, a stage fails if an error is above its threshold.
+	*/
+	std::vector<validationCase> cases;
+	double maxAbs[4];					/* Thresholds for each stage */
+	double maxRel[4];
+	double minSpeedup;					/* Of the whole calculation of a case, 0 to not check */
+
+	ScanPattern pattern(const validationCase& c) const;
+	bool runCase(const validationCase& c, const janniTables& janniData, double sd, std::ostream& report);
+	bool result(std::ostream& report, int stage, double absError, double relError, double referenceTime, double fastTime, double absTolerance = 0, double relTolerance = 0);
+
+public:
+	static const int peaks = 0;
+	static const int penumbra = 1;
+	static const int dose = 2;
+	static const int histogram = 3;
+
+	Validation();
+	bool read(std::string fileName);
+	void addCase(const validationCase& c);
+	void setThreshold(int stage, double absError, double relError);
+	void setSpeedup(double speedup);
+	bool run(const janniTables& janniData, double sd, std::ostream& report);
+
+};
+#endif
@@ -0,0 +1,805 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+#include "doseMaps.h"
+#include "spotPos.h"
+#include "scanSpeed.h"
+#include "Motion.h"
+#include "ScanPattern.h"
+#include "DoseGrid.h"
+#include "TiledGrid.h"
+#include "KernelCache.h"
+#include "PeakTable.h"
+#include "doseCalc.h"
+
+/*
+* The dose calculation used by DoseEngine and the dose program, using
+* formula from M. Lee et. al 1993. and proton energy data from
+* J. Janni 1982.
+*/
+
+/* If run from an input file (disp = false) and only errors are output.*/
+bool disp = true;
+
+
+void input(std::map<int, double>& inputMap, std::string fileName) {
+	/*
+	* Inputs (int, double) pairs from a file.
+	* Used by readJanni().
+	*/
+	std::ifstream inFile ( fileName.c_str() );
+	while(inFile) {
+		double energy;
+		int range;
+		inFile >> range;
+		inFile >> energy;
+		inputMap[range] = energy;
+	}
+}
+
+
+bool readJanni(janniTables& janniData, std::string energyLossFile, std::string rangeEnergyFile) {
+	/*
+	* Replaces the compiled in Janni tables with the files, in the
+	* format of energylossmm and protonEnergymm.  janniData is unchanged
+	* if either file cannot be read.
+	*/
+	std::map<int, double> loss, energy;
+	input(loss, energyLossFile);
+	input(energy, rangeEnergyFile);
+	if (loss.empty() || energy.empty() || loss.begin()->first < 0 || energy.begin()->first < 0)
+		return false;
+	janniData.energyLoss.assign(loss.rbegin()->first + 1, 0);
+	janniData.rangeEnergy.assign(energy.rbegin()->first + 1, 0);
+	for (std::map<int, double>::iterator it = loss.begin(); it != loss.end(); it++)
+		janniData.energyLoss[it->first] = it->second;
+	for (std::map<int, double>::iterator it = energy.begin(); it != energy.end(); it++)
+		janniData.rangeEnergy[it->first] = it->second;
+	return true;
+}
+
+
+bool inputAll(PeakTable& braggPeaks, const janniTables& janniData, double sd, int& maxRange) {
+	/*
+	* Depth dose for Bragg Peaks with peaks at each mm up to
+	* maxRange are input, each peak is read the first time it is used.
+	* Requires file "allPeaks"
+	* Depth dose must have already been calculated from Janni Data.
+	*/
+	if (!braggPeaks.load("allPeaks", sd, janniData))
+		std::cout << "\nInput file Error";
+	else
+		maxRange = braggPeaks.maxRange();
+	return true;
+}
+
+void weight(std::map<int, double>& weight, PeakTable& doseData, int beams, int max, int min, int spacing, int phantomSize, double maxError) {
+	/*
+	* Returns nothing.  Writes weights to the file "weights" required by
+	* calculateDose().  Itteratively calculates Bragg Peak weights until
+	* the dose is within maxError% across the entire SOBP.
+	*/
+	if (disp) std::cout << "\n\nPlease Wait.\n";
+	if(doseData.maxRange() < max) {
+		std::cout << "\n\nERROR input File first";
+		return;
+	}
+	std::map<int, double> depthDose;
+	std::map<int, double> noDose;
+	std::map<int, double> doseInX;
+	for (int i = 0; i < phantomSize; i++){
+		weight[i] = 1;
+	}
+	double minDose, maxDose, error;
+	if (max > phantomSize || min < 0 || max < min) {
+		std::cout << "\n\nMax or Min value out of Range Error, max: " << max << " min: " << min;
+		return;
+	}
+	for (int depth = max; depth >= min; depth = depth -5) {
+		/* Sets initial weights, does not take into account the
+		* dose delivered from Peaks of lower energy.
+		*/
+		weight[depth] = (100 - depthDose[depth]) / (double)100;
+		if (weight[depth] < 0 || weight[depth] > 1) {
+			std::cout << "\nWeight Error :" << weight[depth];
+			break;
+		}
+		for (int x = 0; x < phantomSize; x++) {
+			if (weight[depth] * doseData.dose(depth, x) < 0)
+				std::cout << "error";
+			depthDose[x] = depthDose[x] + weight[depth] * doseData.dose(depth, x);
+		}
+	}
+	weight[max] -= 0.18; /* Weight of max peak is adjusted to reduce the required itterations. */
+	for (int i = 0; i < 1000; i++) {
+		/* Itterates until min Error is reached or 1000 itterations */
+		std::map<int, double> depthDoseWorking;
+		for (int i = 0; i < phantomSize; i++){
+			depthDoseWorking[i] = 0;
+		}
+		for (int x = max; x >= min; x -= spacing) {
+			for (int i = 0; i < (max+20); i++) {
+				depthDoseWorking[i] += weight[x]*doseData.dose(x+1, i);
+			}
+		}
+		minDose = 200;
+		maxDose = 0;
+		for (int x = min; x < max; x++) {
+			if (depthDoseWorking[x] < minDose)
+				minDose = depthDoseWorking[x];
+			if (depthDoseWorking[x] > maxDose)
+				maxDose = depthDoseWorking[x];
+		}
+		error = maxDose - minDose;
+		if (error < maxError) {
+			if (disp) std::cout << "\nMin Error reached";
+			depthDose = depthDoseWorking;
+			break;
+		}
+		for (int x = max; x >= min; x -= spacing) {
+			if (depthDoseWorking[x] < 100) {
+				weight[x] = weight[x] + (100 - depthDoseWorking[x]) / (double)500;
+			}
+			else {
+				weight[x] = weight[x] - (depthDoseWorking[x] - 100) / (double)500;
+			}
+			if (weight[x] < 0 || weight[x] > 2) {
+				std::cout << "\nWeight Error :" << weight[x] << " x: " << x << " dose: " << depthDoseWorking[x];
+				return;
+			}
+		}
+		depthDose = depthDoseWorking;
+	}
+	std::string fileName = "weights";
+	std::ofstream outFile( fileName.c_str() );
+	outFile.precision(8);
+	for (int i = 0; i < weight.size(); i++)
+		outFile << weight[i] << "\n";
+}
+
+
+double normalise(DoseGrid& dose, const Structure& roi, std::vector<int>& movement) {
+	/*
+	* Normalises the dose to 100% at the maximum in the structure moved
+	* by movement, only its runs of voxels are searched.  Returns the
+	* factor the dose was scaled by.
+	*/
+	double max = 0;
+	bool still = movement[0] == 0 && movement[1] == 0 && movement[2] == 0;
+	for (int l = 0; l < roi.numberLevels() && l < dose.numberLevels(); l++) {
+		const gridLevel& level = dose.level(l);
+		double offset[3];
+		bool whole = true;
+		for (int a = 0; a < 3; a++) {
+			offset[a] = movement[a] / level.voxelSize;
+			if (fabs(offset[a] - floor(offset[a] + 0.5)) > 1e-9)
+				whole = false;
+		}
+		const std::vector<size_t>& spans = roi.spans(l);
+		for (size_t s = 0; s < spans.size(); s += 2) {
+			for (size_t v = spans[s]; v < spans[s + 1]; v++) {
+				double voxelDose = level.dose[v];
+				if (!still) {
+					int ijk[3] = {(int)(v / level.n[2] / level.n[1]), (int)(v / level.n[2] % level.n[1]), (int)(v % level.n[2])};
+					voxelDose = movedDose(dose, l, ijk, offset, whole, movement);
+				}
+				if (voxelDose > max)
+					max = voxelDose;
+			}
+		}
+	}
+	max /= 100;
+	if (max > 0)
+		dose.scale((double)1 / max);
+	if (disp) std::cout << "\nDose normalised to 100% at the maximum in " << roi.name() << ", Max was: " << max << "\n";
+	return max > 0 ? (double)1 / max : 1;
+}
+
+
+double normalise(DoseGrid& dose) {
+	/*
+	* Normalises the dose to a maximum of 100%, returns the factor
+	* the dose was scaled by.
+	*/
+	if (disp) std::cout << "\nNormalising dose distribution, Please Wait\n";
+	double max = dose.maxDose() / (double)100;
+	if (max > 0)
+		dose.scale((double)1 / max);
+	if (disp) std::cout << "\nDose normalised to 100% at the maximum, Max was: " << max << "\n";
+	return max > 0 ? (double)1 / max : 1;
+}
+
+
+double normalise(TiledGrid& dose) {
+	/*
+	* Normalises the dose to a maximum of 100%, reading and then
+	* scaling one tile at a time.  Returns the factor the dose was
+	* scaled by.
+	*/
+	if (disp) std::cout << "\nNormalising dose distribution, Please Wait\n";
+	double max = dose.maxDose() / (double)100;
+	if (max > 0)
+		dose.scale((double)1 / max);
+	if (disp) std::cout << "\nDose normalised to 100% at the maximum, Max was: " << max << "\n";
+	return max > 0 ? (double)1 / max : 1;
+}
+
+
+void addMotion(ScanPattern& SP, const scanSpeed& speed, const Motion& m) {
+	//Move spot positions according to the defined motion
+}
+
+
+void addLine(double* dose, double* doseLet, const double* peak, const double* peakLet, const double* penumbra, double weight, int from, int to) {
+	/*
+	* Adds the dose along one line of voxels in depth, and dose times
+	* LET in the same pass if doseLet is given.
+	*/
+	if (doseLet) {
+		for (int k = from; k < to; k++) {
+			dose[k] += weight * peak[k] * penumbra[k];
+			doseLet[k] += weight * peakLet[k] * penumbra[k];
+		}
+	}
+	else {
+		for (int k = from; k < to; k++)
+			dose[k] += weight * peak[k] * penumbra[k];
+	}
+}
+
+
+void spotColumns(const gridLevel& level, int reach, spotPos position, int centre[2], int first[2], int last[2]) {
+	/*
+	* The voxel of level nearest the spot, and the columns [first, last)
+	* in x and y within reach voxels of it.
+	*/
+	for (int a = 0; a < 2; a++) {
+		double spot = a == 0 ? position.x : position.y;
+		centre[a] = (int)floor((spot - level.corner[a]) / level.voxelSize + 0.5);
+		first[a] = centre[a] - reach < 0 ? 0 : centre[a] - reach;
+		last[a] = centre[a] + reach + 1 > level.n[a] ? level.n[a] : centre[a] + reach + 1;
+	}
+}
+
+
+void spotPhase(const gridLevel& level, int phases, spotPos position, const int centre[2], int phase[2]) {
+	// Offset of the spot from the centre of its voxel in 1 / phases of a voxel
+	for (int a = 0; a < 2; a++) {
+		double spot = a == 0 ? position.x : position.y;
+		phase[a] = (int)floor((spot - level.position(a, centre[a])) / level.voxelSize * phases + 0.5);
+		if (phase[a] > (phases + 1) / 2)
+			phase[a] = (phases + 1) / 2;
+		if (phase[a] < -(phases + 1) / 2)
+			phase[a] = -(phases + 1) / 2;
+	}
+}
+
+
+void addSpot(DoseGrid& phantom, spotPos position, std::vector<KernelCache>& kernels) {
+	/*
+	* Add a spot to the given location, calculated up to 40mm either side of the beam and 40mm past the end of the peak
+	* on every level of the grid.  The spot is centred on the nearest voxel of each level,
+	* with the kernel shifted to the nearest phase of the voxel the spot is from its centre.
+	* Dose times LET is added in the same pass on levels that have it.
+	*/
+	for (int l = 0; l < phantom.numberLevels(); l++) {
+		gridLevel& level = phantom.level(l);
+		KernelCache& kernel = kernels[l];
+		const std::vector<double>& peak = kernel.depthDose(position.z);
+		const double* peakLet = level.doseLet.empty() ? 0 : &kernel.depthDoseLet(position.z)[0];
+		int centre[2];
+		int first[2];
+		int last[2];
+		int phase[2];
+		spotColumns(level, kernel.reach(), position, centre, first, last);
+		spotPhase(level, kernel.phases(), position, centre, phase);
+		int zFirst, zLast;
+		level.range(2, 0, kernel.maxDepth(position.z) + level.voxelSize / 2, zFirst, zLast);
+		for (int i = first[0]; i < last[0]; i++) {
+			for (int j = first[1]; j < last[1]; j++) {
+				const double* penumbra = kernel.penumbra(i - centre[0], j - centre[1], phase);
+				double* dose = &level.dose[level.index(i, j, 0)];
+				double* doseLet = peakLet ? &level.doseLet[level.index(i, j, 0)] : 0;
+				if (phantom.covered(l, i, j, level.hole[0][2])) {
+					/* Voxels replaced by the finer level are skipped */
+					addLine(dose, doseLet, &peak[0], peakLet, penumbra, position.weight, zFirst, std::min(zLast, level.hole[0][2]));
+					addLine(dose, doseLet, &peak[0], peakLet, penumbra, position.weight, std::max(zFirst, level.hole[1][2]), zLast);
+				}
+				else
+					addLine(dose, doseLet, &peak[0], peakLet, penumbra, position.weight, zFirst, zLast);
+			}
+		}
+	}
+}
+
+
+void addSpot(TiledGrid& phantom, spotPos position, KernelCache& kernel) {
+	/*
+	* As addSpot() on a single level, each column is found in its tile,
+	* mapping the tile if it is not in memory.
+	*/
+	const gridLevel& level = phantom.level();
+	const std::vector<double>& peak = kernel.depthDose(position.z);
+	int centre[2];
+	int first[2];
+	int last[2];
+	int phase[2];
+	spotColumns(level, kernel.reach(), position, centre, first, last);
+	spotPhase(level, kernel.phases(), position, centre, phase);
+	int zFirst, zLast;
+	level.range(2, 0, kernel.maxDepth(position.z) + level.voxelSize / 2, zFirst, zLast);
+	for (int i = first[0]; i < last[0]; i++) {
+		for (int j = first[1]; j < last[1]; j++) {
+			double* dose = phantom.column(i, j);
+			if (dose)
+				addLine(dose, 0, &peak[0], 0, kernel.penumbra(i - centre[0], j - centre[1], phase), position.weight, zFirst, zLast);
+		}
+	}
+}
+
+
+void deliveredSpots(ScanPattern& SP, std::vector<int>& movement, std::vector<spotPos>& spots) {
+	/*
+	* The spots of SP in the order they are delivered, moved by
+	* -movement.  If the target moves during the delivery every painting
+	* of a spot is added with its share of the weight, moved by the
+	* motion at the time it is delivered.
+	*/
+	spots.clear();
+	for (int layer = 0; layer < SP.numberLayers(); layer++) {
+		int paintings = SP.moving() ? SP.paintings(layer) : 1;
+		for (int painting = 0; painting < paintings; painting++) {
+			for (int spotNo = 0; spotNo < SP.layerSize(layer); spotNo++) {
+				spotPos spot = SP.getSpot(layer, painting, spotNo);
+				spot.x -= movement[0];
+				spot.y -= movement[1];
+				spot.z -= movement[2];
+				spot.weight /= paintings;
+				spots.push_back(spot);
+			}
+		}
+	}
+}
+
+
+static bool beforeInX(const spotPos& a, const spotPos& b) {
+	return a.x < b.x;
+}
+
+
+void resampleKernels(DoseGrid& phantom, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels) {
+	// The Bragg peaks and penumbra are resampled to the voxels of each grid level when they change
+	kernels.resize(phantom.numberLevels());
+	for (int l = 0; l < phantom.numberLevels(); l++) {
+		if (!kernels[l].matches(phantom.level(l)))
+			kernels[l].resample(phantom.level(l), braggPeaks, penumbra, penumbraKey);
+	}
+}
+
+
+bool calculateDose(DoseGrid& phantom, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels, std::vector<int>& movement, const std::atomic<bool>* cancel) {
+	/*
+	* Adds single proton beam spots according to the scanning pattern
+	* ScanPattern SP given as an argument.  The Bragg peaks and penumbra
+	* are resampled to the voxels of each grid level when they change,
+	* penumbraKey identifies the penumbra, see KernelCache::resample().
+	* The target is moved by movement, i.e. every spot by -movement.
+	* Returns false if cancel is set before all spots are added.
+	*/
+	if (disp) std::cout << "\n\nPlease Wait.\n";
+	resampleKernels(phantom, braggPeaks, penumbra, penumbraKey, kernels);
+	std::vector<spotPos> spots;
+	deliveredSpots(SP, movement, spots);
+	for (size_t s = 0; s < spots.size(); s++) {
+		if (cancel && *cancel) {
+			if (disp) std::cout << "Dose calculation cancelled\n";
+			return false;
+		}
+		addSpot(phantom, spots[s], kernels);
+	}
+	if (disp) std::cout << "Dose Calculated\n";
+	return true;
+}
+
+
+bool calculateDose(TiledGrid& phantom, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, KernelCache& kernel, std::vector<int>& movement, const std::atomic<bool>* cancel) {
+	/*
+	* As calculateDose() on a grid held in tiles.  The spots are added
+	* in order of x, and the tiles every later spot is past are
+	* released, so only the tiles within the reach of the kernel of the
+	* current spots are in memory.
+	*/
+	if (disp) std::cout << "\n\nPlease Wait.\n";
+	const gridLevel& level = phantom.level();
+	if (!kernel.matches(level))
+		kernel.resample(level, braggPeaks, penumbra, penumbraKey);
+	std::vector<spotPos> spots;
+	deliveredSpots(SP, movement, spots);
+	std::stable_sort(spots.begin(), spots.end(), beforeInX);
+	int released = 0;			/* Tiles before this are released */
+	for (size_t s = 0; s < spots.size(); s++) {
+		if (cancel && *cancel) {
+			phantom.releaseAll();
+			if (disp) std::cout << "Dose calculation cancelled\n";
+			return false;
+		}
+		int centre[2];
+		int first[2];
+		int last[2];
+		spotColumns(level, kernel.reach(), spots[s], centre, first, last);
+		for (; released < phantom.numberTiles() && released < phantom.tileOf(first[0]); released++)
+			phantom.release(released);
+		addSpot(phantom, spots[s], kernel);
+	}
+	phantom.releaseAll();
+	if (disp) std::cout << "Dose Calculated in " << phantom.numberTiles() << " tiles of " << phantom.tileMB() << " MB, at most " << phantom.maxTiles() << " in memory\n";
+	return true;
+}
+
+
+bool calculateTimeDose(DoseGrid& phantom, DoseTimeline& timeline, int bins, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels, std::vector<int>& movement, const std::atomic<bool>* cancel) {
+	/*
+	* As calculateDose(), but every painting of each spot is given its
+	* delivery time from the scan speed, and the dose is also added to
+	* bins time bins over the delivery in timeline.  A painting delivers
+	* weight / paintings of the spot.  Only the dose of the current bin
+	* is held as a grid, the columns it touched are kept so only they
+	* are moved to the timeline and added to phantom.
+	*/
+	if (disp) std::cout << "\n\nPlease Wait.\n";
+	resampleKernels(phantom, braggPeaks, penumbra, penumbraKey, kernels);
+	if (bins < 1)
+		bins = 1;
+	timeline.define(phantom, bins, SP.deliveryTime());
+	double binWidth = timeline.binTime();
+	DoseGrid binDose = phantom;
+	binDose.clear();
+	std::vector<int> box;
+	int bin = 0;
+	for (int layer = 0; layer < SP.numberLayers(); layer++) {
+		for (int painting = 0; painting < SP.paintings(layer); painting++) {
+			for (int spotNo = 0; spotNo < SP.layerSize(layer); spotNo++) {
+				if (cancel && *cancel) {
+					if (disp) std::cout << "Dose calculation cancelled\n";
+					return false;
+				}
+				double time = SP.spotTime(layer, painting, spotNo);
+				int spotBin = binWidth > 0 ? (int)(time / binWidth) : 0;
+				if (spotBin >= bins)
+					spotBin = bins - 1;
+				for (; bin < spotBin; bin++) {
+					timeline.addBin(binDose, box, phantom);
+					box.clear();
+				}
+				spotPos spot = SP.getSpot(layer, painting, spotNo);
+				spot.x -= movement[0];
+				spot.y -= movement[1];
+				spot.z -= movement[2];
+				spot.weight /= SP.paintings(layer);
+				addSpot(binDose, spot, kernels);
+				if (box.empty()) {
+					box.resize(4 * phantom.numberLevels());
+					for (int l = 0; l < phantom.numberLevels(); l++) {
+						box[4 * l] = box[4 * l + 2] = 1 << 30;
+						box[4 * l + 1] = box[4 * l + 3] = 0;
+					}
+				}
+				for (int l = 0; l < phantom.numberLevels(); l++) {
+					int centre[2];
+					int first[2];
+					int last[2];
+					spotColumns(phantom.level(l), kernels[l].reach(), spot, centre, first, last);
+					box[4 * l] = std::min(box[4 * l], first[0]);
+					box[4 * l + 1] = std::max(box[4 * l + 1], last[0]);
+					box[4 * l + 2] = std::min(box[4 * l + 2], first[1]);
+					box[4 * l + 3] = std::max(box[4 * l + 3], last[1]);
+				}
+			}
+		}
+	}
+	for (; bin < bins; bin++) {
+		timeline.addBin(binDose, box, phantom);
+		box.clear();
+	}
+	if (disp) std::cout << "Dose Calculated in " << bins << " time bins of " << binWidth << " s, " << timeline.size() << " voxel doses stored in " << timeline.bytes() / 1048576 << " MB\n";
+	return true;
+}
+
+
+template <int cutoff, int steps>
+map3D penumbraProfile(const std::vector<double>& re, int maxRange) {
+	/*
+	* Penumbra for depths 1 to maxRange from the range energy re, for
+	* (x, y) up to cutoff mm from the central axis, integrating with
+	* steps elements per mm.  Uses Formula from M. Lee et. al. 1993.
+	*/
+	const double sqrtpi = sqrt(2 * 3.141592654);
+	const double M = protonMass;
+	const double L = radiationLength;
+	map3D Pmono;
+	for (int z = 1; z <= maxRange; z++) {
+		double energy = z < re.size() ? re[z] : 0;
+		double pv = energy * (energy + (double)2 * M)/ (energy + M);		/* Momentum times velocity of the proton */
+		double sqrtPart = (double)(z*z*z)/(double)3/L/(pv*pv);
+		double SDz = 14.1 * (1 + (double)1/(double)9 * log10(z/L)) * sqrt(sqrtPart);		/* Standard Deviation*/
+		double TwoSdSquared = (double)2 * SDz * SDz;
+		double normalisation = 1;			/* To normalise the profile to equal 1 on axis */
+		for (int x = 0; x <= cutoff; x++) {
+			for (int y = x; y <= cutoff; y++) {
+				double distance = sqrt(x*x + y*y);
+				double integral = 0;
+				for (int i = -10 * steps; i <= 0; i++) {
+					double X = (double)i/(double)steps;
+					double temp =  (X * X + distance * distance - (double)2 * X * distance)/ TwoSdSquared;
+					integral += exp(-temp)/steps;    /* Integrating by summing in steps elements per mm */
+				}
+				double value = integral / ( sqrtpi * SDz );
+				if (x == 0 && y == 0)
+					normalisation = value;
+				Pmono[z][x][y] = value/normalisation;     /* Penumbra is normalised to 1 on the axis */
+				Pmono[z][y][x] = value/normalisation;     /* penumbra at (x, y) == penumbra at (y, x) */
+			}
+		}
+	}
+	return Pmono;
+}
+
+
+map3D calcPenumbra(const janniTables& janniData, int maxRange) {
+	/*
+	* Returns the Beam penumbra for all depths up to maxRange from the
+	* range energy in janniData.
+	* Penumbra is calculated from a maximum of 40 mm from the central axis
+	* Penumbra is 0 for > 40 mm from the central axis.
+	*/
+	if (disp) std::cout << "\nCalculating Penumbra, Please Wait\n";
+	return penumbraProfile<penumbraCutoff, penumbraSteps>(janniData.rangeEnergy, maxRange);
+}
+
+
+bool calcPeaks(PeakTable& braggPeaks, const janniTables& janniData, int minRange, int maxRange, double sd) {
+	/*
+	* Sets up the depth dose for Bragg peaks with maximum ranges
+	* from minRange to maxRange.  Uses Formula from M. Lee et. al. 1993.
+	* Each peak is calculated by braggPeaks the first time it is used.
+	*/
+	if (!braggPeaks.configure(minRange, maxRange, sd, janniData))
+		std::cout << "\nInput file Error";
+	else if (disp) std::cout << "\nBragg Peaks from " << minRange << "mm to " << maxRange << "mm will be calculated as they are used.";
+	return true;
+}
+
+
+void targetBox(int targetSize, int phantomSize, std::vector<int>& movement, double lo[3], double hi[3]) {
+	/*
+	* Range in x, y (centred on the beam axis) and z that contains the
+	* target, moved by movement.
+	*/
+	lo[0] = -targetSize/2 + movement[0];
+	hi[0] = targetSize/2 + movement[0];
+	lo[1] = -targetSize/2 + movement[1];
+	hi[1] = targetSize/2 + movement[1];
+	lo[2] = phantomSize/2 - targetSize/2 + movement[2];
+	hi[2] = phantomSize/2 + targetSize/2 + movement[2];
+}
+
+
+bool shiftInvariant(DoseGrid& dose, std::vector<int>& movement, std::vector<double>& intraMove, int targetSize, int phantomSize) {
+	/*
+	* In the homogeneous phantom a rigid shift of the target is the same
+	* as moving the dose grid, so the dose already calculated can be
+	* re-indexed.  Returns false if the shift changes the physics: there
+	* is intrafractional motion, or the moved target leaves the grid level
+	* holding the nominal target.
+	*/
+	for (int i = 0; i < intraMove.size(); i++) {
+		if (intraMove[i] != 0)
+			return false;
+	}
+	if (dose.size() < phantomSize)
+		return false;
+	std::vector<int> none(3);
+	double lo[3], hi[3], movedLo[3], movedHi[3];
+	targetBox(targetSize, phantomSize, none, lo, hi);
+	targetBox(targetSize, phantomSize, movement, movedLo, movedHi);
+	int l = dose.finestLevel(lo, hi);
+	if (dose.finestLevel(movedLo, movedHi) != l)
+		return false;
+	const gridLevel& level = dose.level(l);
+	for (int a = 0; a < 3; a++) {
+		double half = level.voxelSize / 2;
+		if (movedLo[a] < level.corner[a] - half || movedHi[a] > level.position(a, level.n[a] - 1) + half)
+			return false;
+	}
+	return true;
+}
+
+
+double movedDose(const DoseGrid& dose, int l, const int ijk[3], const double offset[3], bool whole, std::vector<int>& movement) {
+	/*
+	* Dose at voxel ijk of level l moved by offset voxels (movement mm).
+	* Whole voxel moves re-index the level, others interpolate it.  If
+	* the moved voxel leaves the level, or reaches voxels covered by a
+	* finer level, the grid is interpolated at the moved point instead.
+	*/
+	const gridLevel& level = dose.level(l);
+	int base[3];
+	double point[3];
+	bool inside = true;
+	for (int a = 0; a < 3; a++) {
+		point[a] = ijk[a] + offset[a];
+		base[a] = whole ? (int)floor(point[a] + 0.5) : (int)floor(point[a]);
+		if (base[a] < 0 || base[a] + (whole ? 0 : 1) >= level.n[a])
+			inside = false;
+	}
+	for (int c = 0; c < (whole ? 1 : 8) && inside; c++) {
+		if (dose.covered(l, base[0] + (c & 1), base[1] + (c >> 1 & 1), base[2] + (c >> 2 & 1)))
+			inside = false;
+	}
+	if (inside)
+		return whole ? level.dose[level.index(base[0], base[1], base[2])] : level.interpolate(point[0], point[1], point[2]);
+	return dose.interpolateAt(level.position(0, ijk[0]) + movement[0], level.position(1, ijk[1]) + movement[1], level.position(2, ijk[2]) + movement[2]);
+}
+
+
+std::vector<int> doseVolume(const DoseGrid& dose, const Structure& roi, std::vector<int>& movement, std::vector<double>& stats) {
+	/*
+	* DVH of a structure moved by movement relative to the calculated
+	* dose, DVH[X] is the volume, in voxels of the finest level, receiving
+	* at least X% dose.  stats is set to the maximum, minimum and mean
+	* dose.  Only the runs of voxels in the structure are visited.
+	*/
+	std::vector<int> DVH(120);
+	stats.assign(3, 0);
+	stats[1] = 120;
+	double total = 0;
+	double volume = 0;
+	bool still = movement[0] == 0 && movement[1] == 0 && movement[2] == 0;
+	for (int l = 0; l < roi.numberLevels() && l < dose.numberLevels(); l++) {
+		const gridLevel& level = dose.level(l);
+		/* Levels nest (DoseGrid::nests) so a voxel is a whole number of the finest */
+		int weight = (int)(pow(level.voxelSize / dose.finestVoxelSize(), 3) + 0.5);
+		double offset[3];
+		bool whole = true;
+		for (int a = 0; a < 3; a++) {
+			offset[a] = movement[a] / level.voxelSize;
+			if (fabs(offset[a] - floor(offset[a] + 0.5)) > 1e-9)
+				whole = false;
+		}
+		const std::vector<size_t>& spans = roi.spans(l);
+		for (size_t s = 0; s < spans.size(); s += 2) {
+			int ijk[3];
+			ijk[2] = spans[s] % level.n[2];
+			ijk[1] = (spans[s] / level.n[2]) % level.n[1];
+			ijk[0] = spans[s] / level.n[2] / level.n[1];
+			for (size_t v = spans[s]; v < spans[s + 1]; v++) {
+				if (ijk[2] == level.n[2]) {
+					/* Runs can continue into the next column */
+					ijk[2] = 0;
+					if (++ijk[1] == level.n[1]) {
+						ijk[1] = 0;
+						ijk[0]++;
+					}
+				}
+				double voxelDose = still ? level.dose[v] : movedDose(dose, l, ijk, offset, whole, movement);
+				ijk[2]++;
+				if (voxelDose > stats[0])
+					stats[0] = voxelDose;
+				if (voxelDose < stats[1])
+					stats[1] = voxelDose;
+				total += weight * voxelDose;
+				volume += weight;
+				int percentDose = (int)(voxelDose + 0.5);
+				/* C++ always rounds down for int conversion, + 0.5 results
+				*  in the 'normal' way to round a double to an int. */
+				if (percentDose < 0 || percentDose >= 120)
+					std::cout << "\n\nPercent dose out of Range Error: " << roi.name() << " " << percentDose;
+				else {
+					for (int i = percentDose; i >= 0; i--)
+						DVH[i] += weight;
+				}
+			}
+		}
+	}
+	if (volume > 0)
+		stats[2] = total / volume;
+	return DVH;
+}
+
+
+std::vector<int> doseVolume(TiledGrid& dose, const Structure& roi, std::vector<double>& stats) {
+	/*
+	* As doseVolume() for a structure built on dose.grid(), the runs are
+	* in the order of the file so each tile is read once and released
+	* when the runs have passed it.
+	*/
+	std::vector<int> DVH(120);
+	stats.assign(3, 0);
+	stats[1] = 120;
+	double total = 0;
+	double volume = 0;
+	if (roi.numberLevels() == 0)
+		return DVH;
+	const gridLevel& level = dose.level();
+	size_t slabSize = (size_t)level.n[1] * level.n[2];
+	const std::vector<size_t>& spans = roi.spans(0);
+	int current = -1;
+	double* doses = 0;
+	for (size_t s = 0; s < spans.size(); s += 2) {
+		for (size_t v = spans[s]; v < spans[s + 1]; v++) {
+			int t = dose.tileOf(v / slabSize);
+			if (t != current) {
+				if (current >= 0)
+					dose.release(current);
+				current = t;
+				doses = dose.tile(t);
+			}
+			if (!doses)
+				continue;
+			double voxelDose = doses[v - dose.firstVoxel(t)];
+			if (voxelDose > stats[0])
+				stats[0] = voxelDose;
+			if (voxelDose < stats[1])
+				stats[1] = voxelDose;
+			total += voxelDose;
+			volume++;
+			int percentDose = (int)(voxelDose + 0.5);
+			if (percentDose < 0 || percentDose >= 120)
+				std::cout << "\n\nPercent dose out of Range Error: " << roi.name() << " " << percentDose;
+			else {
+				for (int i = percentDose; i >= 0; i--)
+					DVH[i]++;
+			}
+		}
+	}
+	if (current >= 0)
+		dose.release(current);
+	if (volume > 0)
+		stats[2] = total / volume;
+	return DVH;
+}
+
+
+sMap calcDoseVol(DoseGrid& dose, const std::vector<Structure>& structures, std::vector<int>& movement, std::vector<double>& maxMin) {
+	/*
+	* Returns a DVH for every structure, built on the grid of dose,
+	* moved by movement relative to the calculated dose.
+	* DVH["target"][X] = number of voxels recieving at least X% Dose
+	* maxMin is set to the maximum and minimum dose in the target.
+	*/
+	sMap DVH;
+	if (dose.numberLevels() == 0) {
+		std::cout << "\n\nERROR calculate dose first";
+		return DVH;
+	}
+	maxMin[0] = 0;
+	maxMin[1] = 120;
+	for (int s = 0; s < structures.size(); s++) {
+		std::vector<double> stats;
+		DVH[structures[s].name()] = doseVolume(dose, structures[s], movement, stats);
+		if (structures[s].name() == "target") {
+			maxMin[0] = stats[0];
+			maxMin[1] = stats[1];
+		}
+	}
+	if (disp) std::cout << "\n\nDose Volume histogram calculated";
+	return DVH;
+}
+
+
+void defineGrid(DoseGrid& phantom, int phantomSize, int size, int margin, double voxelSize, double coarseVoxelSize) {
+	/*
+	* Fine voxels cover the target and margin, coarse voxels the rest
+	* of the phantom.
+	*/
+	double fineMin[3] = {-size/2.0 - margin, -size/2.0 - margin, phantomSize/2.0 - size/2.0 - margin};
+	double fineMax[3] = {size/2.0 + margin, size/2.0 + margin, phantomSize/2.0 + size/2.0 + margin};
+	phantom.define(phantomSize, coarseVoxelSize, voxelSize, fineMin, fineMax);
+}
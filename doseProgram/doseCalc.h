@@ -0,0 +1,58 @@
+#ifndef DOSECALC_H
+#define DOSECALC_H
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include "doseMaps.h"
+#include "spotPos.h"
+#include "scanSpeed.h"
+#include "Motion.h"
+#include "ScanPattern.h"
+#include "DoseGrid.h"
+#include "TiledGrid.h"
+#include "DoseTimeline.h"
+#include "Structure.h"
+#include "KernelCache.h"
+#include "janniTables.h"
+#include "PeakTable.h"
+
+/*
+* The dose calculation functions, used by DoseEngine and the dose
+* program.
+*/
+
+typedef std::map< std::string, std::vector<int> > sMap;
+
+/* If run from an input file (disp = false) and only errors are output.*/
+extern bool disp;
+
+void input(std::map<int, double>& inputMap, std::string fileName);
+bool readJanni(janniTables& janniData, std::string energyLossFile, std::string rangeEnergyFile);
+bool inputAll(PeakTable& braggPeaks, const janniTables& janniData, double sd, int& maxRange);
+void weight(std::map<int, double>& weight, PeakTable& doseData, int beams, int max, int min, int spacing, int phantomSize, double maxError);
+double normalise(DoseGrid& dose, const Structure& roi, std::vector<int>& movement);
+double normalise(DoseGrid& dose);
+double normalise(TiledGrid& dose);
+void addMotion(ScanPattern& SP, const scanSpeed& speed, const Motion& m);
+void addLine(double* dose, double* doseLet, const double* peak, const double* peakLet, const double* penumbra, double weight, int from, int to);
+void spotColumns(const gridLevel& level, int reach, spotPos position, int centre[2], int first[2], int last[2]);
+void spotPhase(const gridLevel& level, int phases, spotPos position, const int centre[2], int phase[2]);
+void deliveredSpots(ScanPattern& SP, std::vector<int>& movement, std::vector<spotPos>& spots);
+void addSpot(DoseGrid& phantom, spotPos position, std::vector<KernelCache>& kernels);
+void addSpot(TiledGrid& phantom, spotPos position, KernelCache& kernel);
+void resampleKernels(DoseGrid& phantom, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels);
+bool calculateDose(DoseGrid& phantom, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels, std::vector<int>& movement, const std::atomic<bool>* cancel = 0);
+bool calculateDose(TiledGrid& phantom, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, KernelCache& kernel, std::vector<int>& movement, const std::atomic<bool>* cancel = 0);
+bool calculateTimeDose(DoseGrid& phantom, DoseTimeline& timeline, int bins, ScanPattern SP, PeakTable& braggPeaks, map3D& penumbra, size_t penumbraKey, std::vector<KernelCache>& kernels, std::vector<int>& movement, const std::atomic<bool>* cancel = 0);
+map3D calcPenumbra(const janniTables& janniData, int maxRange);
+bool calcPeaks(PeakTable& braggPeaks, const janniTables& janniData, int minRange, int maxRange, double sd);
+void targetBox(int targetSize, int phantomSize, std::vector<int>& movement, double lo[3], double hi[3]);
+bool shiftInvariant(DoseGrid& dose, std::vector<int>& movement, std::vector<double>& intraMove, int targetSize, int phantomSize);
+double movedDose(const DoseGrid& dose, int l, const int ijk[3], const double offset[3], bool whole, std::vector<int>& movement);
+std::vector<int> doseVolume(const DoseGrid& dose, const Structure& roi, std::vector<int>& movement, std::vector<double>& stats);
+std::vector<int> doseVolume(TiledGrid& dose, const Structure& roi, std::vector<double>& stats);
+sMap calcDoseVol(DoseGrid& dose, const std::vector<Structure>& structures, std::vector<int>& movement, std::vector<double>& maxMin);
+void defineGrid(DoseGrid& phantom, int phantomSize, int size, int margin, double voxelSize, double coarseVoxelSize);
+
+#endif
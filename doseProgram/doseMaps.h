@@ -0,0 +1,12 @@
+#ifndef DOSEMAPS_
+#define DOSEMAPS_
+#include <map>
+
+/*
+* Tables indexed in mm, e.g. braggPeaks[range][depth] and
+* penumbra[depth][x][y].
+*/
+typedef std::map<int, std::map<int, double> > map2D;
+typedef std::map<int, std::map<int, std::map<int, double> > > map3D;
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+#include <string>
+#include <vector>
+#include <functional>
+
+struct fingerprint {
+	/*
+	* The parameters a stage of the calculation depends on combined
+	* into one value, e.g. fingerprint() << maxRange << sd.
+	*/
+	size_t value;
+
+	fingerprint() : value(0) {}
+	void mix(size_t h) { value ^= h + 0x9e3779b9 + (value << 6) + (value >> 2); }
+	template<class T> fingerprint& operator<<(const T& x) { mix(std::hash<T>()(x)); return *this; }
+	template<class T> fingerprint& operator<<(const std::vector<T>& x) {
+		mix(x.size());
+		for (size_t i = 0; i < x.size(); i++)
+			*this << x[i];
+		return *this;
+	}
+	operator size_t() const { return value; }
+};
+
+#endif
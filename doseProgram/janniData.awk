@@ -0,0 +1,27 @@
+# Writes janniData.h from energylossmm and protonEnergymm (in that order),
+# each a list of (range in mm, value) pairs.  The tables become constexpr
+# arrays indexed by the range in mm, missing ranges are 0.
+FNR == 1 { files[++n] = FILENAME }
+{ sub(/\r$/, "") }
+NF >= 2 {
+	value[n, $1 + 0] = $2
+	if ($1 + 0 > size[n]) size[n] = $1 + 0
+}
+END {
+	name[1] = "energyLoss"
+	name[2] = "rangeEnergy"
+	print "/* Generated by make from " files[1] " and " files[2] " by janniData.awk, do not edit. */"
+	print "#ifndef JANNIDATA_H"
+	print "#define JANNIDATA_H"
+	print ""
+	print "namespace janni {"
+	for (f = 1; f <= 2; f++) {
+		printf "constexpr int %sSize = %d;\n", name[f], size[f] + 1
+		printf "constexpr double %s[%sSize] = {", name[f], name[f]
+		for (i = 0; i <= size[f]; i++)
+			printf "%s%s", (i % 8 ? ", " : (i ? ",\n\t" : "\n\t")), ((f, i) in value ? value[f, i] : 0)
+		print "\n};"
+	}
+	print "}"
+	print "#endif"
+}
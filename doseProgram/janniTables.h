@@ -0,0 +1,27 @@
+#ifndef JANNITABLES_
+#define JANNITABLES_
+#include <vector>
+#include "janniData.h"
+
+/*
+* Physical constants and the Janni 1982 tables for water.  The tables
+* are compiled in from energylossmm and protonEnergymm (janniData.h is
+* generated by make), files with the same format can replace them at
+* runtime with readJanni().
+*/
+
+constexpr double protonMass = 938.3;			/* Proton rest mass (MeV) */
+constexpr double radiationLength = 500;		/* radiation length of water in mm */
+constexpr int penumbraCutoff = 40;				/* Penumbra is 0 for > 40 mm from the central axis */
+constexpr int penumbraSteps = 100;				/* Elements per mm integrating the penumbra */
+
+struct janniTables {
+	std::vector<double> energyLoss;		/* energyLoss[R] is the energy loss per mm for a proton with range R mm */
+	std::vector<double> rangeEnergy;	/* rangeEnergy[R] is the energy (MeV) of a proton with range R mm */
+
+	janniTables() :
+		energyLoss(janni::energyLoss, janni::energyLoss + janni::energyLossSize),
+		rangeEnergy(janni::rangeEnergy, janni::rangeEnergy + janni::rangeEnergySize) {}
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include "doseMaps.h"
+#include "spotPos.h"
+#include "ScanPattern.h"
+#include "janniTables.h"
+#include "referenceCalc.h"
+
+static double integrate(std::map<int, double> fx) {
+	/*
+	* Integrates area in cubic mm for a function with
+	* values given at mm intervals.
+	*/
+	double S = 0;
+	for (int i = 0; i < fx.size(); i++) {
+		S += fx[i];
+	}
+	return S;
+}
+
+
+map2D referencePeaks(const janniTables& janniData, int minRange, int maxRange, double sd) {
+	/*
+	* Returns the depth dose for Bragg peaks with maximum ranges
+	* from minRange to maxRange - 1.  Uses Formula from M. Lee et. al. 1993.
+	*/
+	int maxCalc = maxRange +10;
+	std::map<int, double> energyLoss;			/* energyLoss[R] is the energy loss per mm for a proton with range R. */
+	map2D Dmono, Dele;						/* Dmono[R][Z] is Dmono(R,Z) in eqn 1 similarly Dele in eqn 3*/
+	std::map<int, double> fx;					/* fx is the integrand in eqn 3 from Lee et. al. */
+	for (int R = 0; R < janniData.energyLoss.size(); R++)
+		energyLoss[R] = janniData.energyLoss[R];
+	for (int R = 0; R < maxCalc; R++) {
+		double denomintor = (double)1 / (0.0012*R+1);
+		for (int dist = 0; dist <= R; dist++){
+			(Dmono[R])[R-dist] = energyLoss[dist] * (0.0012*dist+1) * denomintor;
+		}
+	}
+	for (int Ro = minRange +3; Ro < maxRange +3; Ro++) {
+		double rrsd;
+		for (int Z = 0; Z < maxCalc; Z++) {
+			for (int R = 0; R < maxCalc;  R++) {
+				rrsd = (R - Ro) * (R - Ro) / sd;
+				fx[R] = exp(-rrsd) * Dmono[R][Z];
+			}
+			Dele[Ro -3][Z] = integrate(fx);
+		}
+	}
+	return Dele;
+}
+
+
+map3D referencePenumbra(const janniTables& janniData, int maxDepth) {
+	/*
+	* Returns the Beam penumbra for all depths up to maxDepth, up to
+	* 40 mm from the central axis.  Uses Formula from M. Lee et. al. 1993.
+	* Depth 0 takes the 1 mm penumbra as in KernelCache, the original
+	* left it empty.
+	*/
+	double M = 938.3;  						/* Proton rest mass (MeV) */
+	double sqrtpi = sqrt(2 * 3.141592654);
+	double L = 500;						/* radiation length of water in mm */
+	double pv;								/* Momentum times velocity of the proton */
+	std::map<int, double> re; 				/* Range Energy */
+	double SDz;								/* Standard Deviation*/
+	double normalisation = 1;				/* To normalise the profile to equal 1 on axis */
+	map3D Pmono;
+	for (int R = 0; R < janniData.rangeEnergy.size(); R++)
+		re[R] = janniData.rangeEnergy[R];
+	for (int z = 1; z <= maxDepth; z++) {
+		pv = re[z] * (re[z] + (double)2 * M)/ (re[z] + M);
+		double sqrtPart = (double)(z*z*z)/(double)3/L/(pv*pv);
+		SDz = 14.1 * (1 + (double)1/(double)9 * log10(z/L)) * sqrt(sqrtPart);
+		double TwoSdSquared = (double)2 * SDz * SDz;
+		for (int x = 0; x <= 40; x++) {		/* Calculates the penumbra up to 40 mm in both x and y directions */
+			for (int y = x; y <= 40; y++) {
+				double distance = sqrt(x*x + y*y);
+				double integral = 0;
+				for (int i = -1000; i <= 0; i++) {
+					double X = (double)i/(double)100;
+					double temp =  (X * X + distance * distance - (double)2 * X * distance)/ TwoSdSquared;
+					integral += exp(-temp)/100;    /* Integrating by summing in 100 elements per mm */
+				}
+				double value = integral / ( sqrtpi * SDz );
+				if (x == 0 && y == 0)
+					normalisation = value;
+				Pmono[z][x][y] = value/normalisation;     /* Penumbra is normalised to 1 on the axis */
+				Pmono[z][y][x] = value/normalisation;     /* penumbra at (x, y) == penumbra at (y, x) */
+			}
+		}
+	}
+	if (maxDepth >= 1)
+		Pmono[0] = Pmono[1];
+	return Pmono;
+}
+
+
+void referenceSpot(map3D& phantom, spotPos position, map2D& braggPeaks, map3D& penumbra) {
+	/*
+	* Add a spot to the given location, calculated up to 40mm either side of the beam and 40mm past the end of the peak.
+	* The original added each quadrant from the axis, counting the
+	* voxels on the axes twice and stopping 1 mm short in x, every
+	* voxel within 40 mm is added once here.  The maps are per mm, the
+	* spot is rounded to the nearest mm.
+	*/
+	int depth = (int)floor(position.z + 0.5);
+	int centre[2] = {(int)floor(position.x + 0.5), (int)floor(position.y + 0.5)};
+	for (int z = 0; z <= depth + 40; z++) {
+		double peak = braggPeaks[depth][z] * position.weight;
+		std::map<int, std::map<int, double> >& plane = penumbra[z];
+		for (int x = -40; x <= 40; x++) {
+			for (int y = -40; y <= 40; y++) {
+				phantom[centre[0] + x][centre[1] + y][z] += peak * plane[abs(x)][abs(y)];
+			}
+		}
+	}
+}
+
+
+void referenceDose(map3D& phantom, ScanPattern SP, map2D& braggPeaks, map3D& penumbra) {
+	/*
+	* Adds single proton beam spots according to the scanning pattern
+	* ScanPattern SP given as an argument.
+	*/
+	spotPos spot;
+	SP.reset();
+	spot = SP.getSpot();
+	while (spot.weight >= 0) {
+		referenceSpot(phantom, spot, braggPeaks, penumbra);
+		spot = SP.getNextSpot();
+	}
+}
+
+
+void referenceNormalise(map3D& dose, int phantomSize) {
+	/*
+	* Normalises the dose to a maximum of 100% within the phantom,
+	* x and y from -phantomSize/2 and z from 0 up to phantomSize.
+	*/
+	double max = 0;
+	for (map3D::iterator x = dose.begin(); x != dose.end(); x++) {
+		if (2 * x->first < -phantomSize || 2 * x->first >= phantomSize)
+			continue;
+		for (map2D::iterator y = x->second.begin(); y != x->second.end(); y++) {
+			if (2 * y->first < -phantomSize || 2 * y->first >= phantomSize)
+				continue;
+			for (std::map<int, double>::iterator z = y->second.begin(); z != y->second.end(); z++) {
+				if (z->first < phantomSize && z->second > max)
+					max = z->second;
+			}
+		}
+	}
+	max = max / (double)100;
+	if (max == 0)
+		return;
+	for (map3D::iterator x = dose.begin(); x != dose.end(); x++) {
+		for (map2D::iterator y = x->second.begin(); y != x->second.end(); y++) {
+			for (std::map<int, double>::iterator z = y->second.begin(); z != y->second.end(); z++)
+				z->second = z->second / max;
+		}
+	}
+}
+
+
+std::vector<int> referenceDoseVol(map3D& dose, int targetSize, int phantomSize, std::vector<double>& maxMin) {
+	/*
+	* Returns the target DVH, DVH[X] = number of cubic mm recieving at
+	* least X% Dose.  The target is centred on the beam axis in x and y.
+	*/
+	std::vector<int> targetDose(120);
+	maxMin.assign(2, 0);
+	maxMin[1] = 120;
+	int xRange[2];
+	int zRange[2];
+	/* Range in x and y that contains the target */
+	xRange[0] = -targetSize/2;
+	xRange[1] = targetSize/2;
+	zRange[0] = phantomSize/2 - targetSize/2;
+	zRange[1] = phantomSize/2 + targetSize/2;
+	for (int x = xRange[0]; x < xRange[1]; x++) {
+		/* Loops throught all the points inside the target */
+		for (int y = xRange[0]; y < xRange[1]; y++) {
+			for (int z = zRange[0]; z < zRange[1]; z++) {
+				double value = dose[x][y][z];
+				if (value > maxMin[0])
+					maxMin[0] = value;
+				if (value < maxMin[1])
+					maxMin[1] = value;
+				int percentDose = (int)(value + 0.5);
+				if (percentDose >= 0 && percentDose < 120) {
+					for (int i = percentDose; i >= 0; i--)
+						targetDose[i]++;
+				}
+			}
+		}
+	}
+	return targetDose;
+}
@@ -0,0 +1,22 @@
+#ifndef REFERENCECALC_H
+#define REFERENCECALC_H
+#include <vector>
+#include "doseMaps.h"
+#include "spotPos.h"
+#include "ScanPattern.h"
+#include "janniTables.h"
+
+/*
+* The original map based calculation from Lee et. al. 1993, kept as
+* the reference the optimised calculation in doseCalc is validated
+* against, see Validation.  Tables and doses are indexed in mm.
+*/
+
+map2D referencePeaks(const janniTables& janniData, int minRange, int maxRange, double sd);
+map3D referencePenumbra(const janniTables& janniData, int maxDepth);
+void referenceSpot(map3D& phantom, spotPos position, map2D& braggPeaks, map3D& penumbra);
+void referenceDose(map3D& phantom, ScanPattern SP, map2D& braggPeaks, map3D& penumbra);
+void referenceNormalise(map3D& dose, int phantomSize);
+std::vector<int> referenceDoseVol(map3D& dose, int targetSize, int phantomSize, std::vector<double>& maxMin);
+
+#endif
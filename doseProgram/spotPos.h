@@ -3,11 +3,12 @@
 
 struct spotPos {
 	/*
-	* Position and weight of a single Bragg peak
+	* Position (mm) and weight of a single Bragg peak, z is the range.
+	* Positions need not be on whole mm, e.g. spots moved by Motion.
 	*/
-	int x;
-	int y;
-	int z;
+	double x;
+	double y;
+	double z;
 	double weight;
 };
 